@@ -21,7 +21,10 @@ QtObject {
     readonly property url imagePath: "file://" + WebOS.qmlDir + "/WebOSCompositorBase/resources/images/"
     readonly property var settings: {
         "compositor": {
-            "geometryPendingInterval": 2000
+            "geometryPendingInterval": 2000,
+            "frameTimeBudget": 0,
+            "minimumRenderScale": 0.75,
+            "incubateViews": true
         },
         "debug": {
             "enable": false,
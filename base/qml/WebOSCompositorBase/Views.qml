@@ -37,6 +37,13 @@ FocusScope {
         rotation: compositorWindow.outputRotation
         clip: compositorWindow.outputClip
 
+        // Render at a reduced resolution while frames are over budget
+        // and let the layer upscale it to the output. renderScale only
+        // changes once per busy period, not to allocate the layer often.
+        layer.enabled: compositorWindow.renderScale < 1.0
+        layer.textureSize: Qt.size(width * compositorWindow.renderScale, height * compositorWindow.renderScale)
+        layer.smooth: true
+
         ViewsRoot {
             id: viewsRoot
             anchors.fill: parent
@@ -44,6 +51,7 @@ FocusScope {
 
         Loader {
             anchors.fill: parent
+            asynchronous: Settings.local.compositor.incubateViews
             source: Settings.local.debug.enable ? "views/debug/DebugOverlay.qml" : ""
         }
     }
@@ -55,6 +63,10 @@ FocusScope {
 
         Component.onCompleted: {
             compositorWindow.outputGeometryPendingInterval = Settings.local.compositor.geometryPendingInterval;
+            if (Settings.local.compositor.frameTimeBudget > 0) {
+                compositorWindow.minimumRenderScale = Settings.local.compositor.minimumRenderScale;
+                compositorWindow.frameTimeBudget = Settings.local.compositor.frameTimeBudget;
+            }
         }
     }
 }
@@ -20,6 +20,7 @@ Item {
     id: root
 
     property var views
+    property bool restricted: false
 
     // Access properties for UI components and key events
     // true: allow to show(default), false: disallow to show
@@ -35,8 +36,19 @@ Item {
         }
     }
 
+    Connections {
+        target: views
+        onViewIncubated: {
+            if (restricted && typeof view.access !== "undefined") {
+                console.log("AccessControl: restrict access to " + view);
+                view.access = false;
+            }
+        }
+    }
+
     function toRestrictedMode() {
         console.info("AccessControl: the restricted mode is set.");
+        restricted = true;
         for (var i = 0; i < views.children.length; i++) {
             if (views.children[i] != views.fullscreen && typeof views.children[i].access !== "undefined") {
                 console.log("AccessControl: restrict access to " + views.children[i]);
@@ -50,6 +62,7 @@ Item {
 
     function reset() {
         console.info("AccessControl: get back to the default access control policy.");
+        restricted = false;
         for (var i = 0; i < views.children.length; i++) {
             if (typeof views.children[i].access !== "undefined") {
                 console.log("AccessControl: allow access to " + views.children[i]);
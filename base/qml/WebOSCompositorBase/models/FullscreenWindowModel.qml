@@ -19,6 +19,7 @@ import WebOSCoreCompositor 1.0
 
 WindowModel {
     surfaceSource: compositor.surfaceModel
+    displayId: compositor.windowCount > 1 ? compositorWindow.displayId : -1
     acceptFunction: "filter"
 
     function filter(surfaceItem) {
@@ -19,5 +19,6 @@ import WebOSCoreCompositor 1.0
 
 WindowModel {
     surfaceSource: compositor.surfaceModel
+    displayId: compositor.windowCount > 1 ? compositorWindow.displayId : -1
     windowType: "_WEBOS_WINDOW_TYPE_POPUP"
 }
@@ -29,7 +29,7 @@ Service {
 
     property var views
 
-    readonly property var defaultMethods: ["closeByAppId", "getForegroundAppInfo", "captureCompositorOutput"]
+    readonly property var defaultMethods: ["closeByAppId", "getForegroundAppInfo", "captureCompositorOutput", "getGraphicsMemoryUsage", "getStartupTimeline"]
 
     readonly property ForegroundAppInfoMgr foregroundAppInfoMgr: ForegroundAppInfoMgr {
         items: root.views.children
@@ -72,6 +72,31 @@ Service {
         return JSON.stringify(ret);
     }
 
+    function getGraphicsMemoryUsage(param) {
+        var ret = {};
+        var manager = compositor.memoryManager;
+
+        console.info("LS2 method handler is called with param: " + JSON.stringify(param));
+
+        ret.bufferBytes = manager.bufferBytes;
+        ret.textureBytes = manager.textureBytes;
+        ret.snapshotBytes = manager.snapshotBytes;
+        ret.clients = manager.clientUsage();
+        ret.apps = manager.appUsage();
+
+        return JSON.stringify(ret);
+    }
+
+    function getStartupTimeline(param) {
+        var ret = {};
+
+        console.info("LS2 method handler is called with param: " + JSON.stringify(param));
+
+        ret.timeline = compositor.startupTimeline();
+
+        return JSON.stringify(ret);
+    }
+
     function captureCompositorOutput(param) {
         var path = "";
         var target = null;
@@ -33,6 +33,8 @@ SurfaceView {
             currentItem.parent = root;
             currentItem.opacity = 0.999;
             currentItem.useTextureAlpha = true;
+            // Hides what is below it, for the exposed region of those
+            currentItem.opaque = true;
             root.requestFocus();
             root.openView();
             if (oldItem)
@@ -45,10 +45,17 @@ BaseView {
             console.log("Adding item " + item + " to " + root);
             if (root.access) {
                 item.parent = root;
-                item.visible = true;
                 item.opacity = 0.999;
                 item.useTextureAlpha = true;
                 currentItem = item;
+                if (compositor.inputMethod.standby && !compositor.inputMethod.active) {
+                    // Mapped ahead by the standby input method, keep it
+                    // hidden until a text model gets activated.
+                    item.visible = false;
+                    console.log("Item parked in " + root + " until the input method is activated");
+                    return;
+                }
+                item.visible = true;
                 root.openView();
                 root.contentChanged();
                 console.log("Item added in " + root + ", currentItem: " + currentItem);
@@ -78,6 +85,19 @@ BaseView {
         }
     }
 
+    Connections {
+        target: compositor.inputMethod
+
+        onInputMethodActivated: {
+            if (currentItem && !currentItem.visible) {
+                console.log("Showing parked item " + currentItem + " in " + root);
+                currentItem.visible = true;
+                root.openView();
+                root.contentChanged();
+            }
+        }
+    }
+
     openAnimation: SequentialAnimation {
         PropertyAnimation {
             target: root
@@ -23,55 +23,133 @@ FocusScope {
     id: compositorRoot
     focus: true
 
+    // Views other than the fullscreen one are created after the first
+    // frame, see incubateViews()
     property alias fullscreen: fullscreenViewId
-    property alias overlay: overlayViewId
-    property alias launcher: launcherId
-    property alias popup: popupViewId
-    property alias notification: notificationViewId
-    property alias keyboard: keyboardViewId
-    property alias spinner: spinnerId
+    property Item overlay: null
+    property Item launcher: null
+    property Item popup: null
+    property Item notification: null
+    property Item keyboard: null
+    property Item spinner: null
 
+    // Whether all views have been created
+    property bool incubated: false
+
+    signal viewIncubated(Item view)
+
+    // Stacked by z as they may be created in any order
     FullscreenView {
         id: fullscreenViewId
         objectName: "fullscreenView"
         anchors.fill: parent
+        z: 0
         model: FullscreenWindowModel {}
     }
 
-    OverlayView {
-        id: overlayViewId
-        objectName: "overlayView"
-        anchors.fill: parent
-        model: OverlayWindowModel {}
+    Component {
+        id: overlayComponent
+        OverlayView {
+            objectName: "overlayView"
+            anchors.fill: parent
+            z: 1
+            model: OverlayWindowModel {}
+        }
     }
 
-    Launcher {
-        id: launcherId
-        objectName: "launcher"
-        anchors.fill: parent
+    Component {
+        id: launcherComponent
+        Launcher {
+            objectName: "launcher"
+            anchors.fill: parent
+            z: 2
+        }
     }
 
-    PopupView {
-        id: popupViewId
-        objectName: "popupView"
-        model: PopupWindowModel {}
+    Component {
+        id: popupComponent
+        PopupView {
+            objectName: "popupView"
+            z: 3
+            model: PopupWindowModel {}
+        }
     }
 
-    NotificationView {
-        id: notificationViewId
-        objectName: "notificationView"
-        anchors.fill: parent
+    Component {
+        id: notificationComponent
+        NotificationView {
+            objectName: "notificationView"
+            anchors.fill: parent
+            z: 4
+        }
     }
 
-    KeyboardView {
-        id: keyboardViewId
-        objectName: "keyboardView"
-        model: KeyboardWindowModel {}
+    Component {
+        id: keyboardComponent
+        KeyboardView {
+            objectName: "keyboardView"
+            z: 5
+            model: KeyboardWindowModel {}
+        }
     }
 
-    Spinner {
-        id: spinnerId
-        objectName: "spinner"
-        anchors.fill: parent
+    Component {
+        id: spinnerComponent
+        Spinner {
+            objectName: "spinner"
+            anchors.fill: parent
+            z: 6
+        }
+    }
+
+    // In order of priority, what the first app may need first
+    readonly property var incubationQueue: [
+        { "name": "spinner", "component": spinnerComponent },
+        { "name": "keyboard", "component": keyboardComponent },
+        { "name": "popup", "component": popupComponent },
+        { "name": "overlay", "component": overlayComponent },
+        { "name": "notification", "component": notificationComponent },
+        { "name": "launcher", "component": launcherComponent }
+    ]
+
+    // Creates the views one after another. When asynchronous, the
+    // incubation takes place in the idle time between frames.
+    function incubateViews(index) {
+        if (index >= incubationQueue.length) {
+            console.info("ViewsRoot: all views incubated");
+            incubated = true;
+            return;
+        }
+
+        var entry = incubationQueue[index];
+        var mode = Settings.local.compositor.incubateViews ? Qt.Asynchronous : Qt.Synchronous;
+        var incubator = entry.component.incubateObject(compositorRoot, {}, mode);
+        var done = function(status) {
+            if (status == Component.Ready) {
+                compositorRoot[entry.name] = incubator.object;
+                viewIncubated(incubator.object);
+                adoptSurfaces(incubator.object);
+            } else {
+                console.warn("ViewsRoot: failed to incubate " + entry.name + ", " + entry.component.errorString());
+            }
+            incubateViews(index + 1);
+        };
+
+        if (incubator.status == Component.Loading)
+            incubator.onStatusChanged = done;
+        else
+            done(incubator.status);
     }
+
+    // A view created once the views are ready has missed the surfaces its
+    // model had already, which are added to it now as if just mapped.
+    // Views created before that are told by the compositor.
+    function adoptSurfaces(view) {
+        if (!compositor.viewsReady || !view.model || view.model.count === undefined)
+            return;
+        for (var i = 0; i < view.model.count; i++)
+            view.model.surfaceAdded(view.model.get(i));
+    }
+
+    Component.onCompleted: incubateViews(0)
 }
@@ -52,6 +52,7 @@ DebugWindow {
                     Text { text: surface ? "fullscreen: " + surface.fullscreen : ""; font.pixelSize: 15 }
                     Text { text: surface ? "tick: "+surface.lastFullscreenTick : ""; font.pixelSize: 15 }
                     Text { text: surface ? "snap: "+surface.cardSnapShotFilePath : ""; font.pixelSize: 15 }
+                    Text { text: surface ? "gfx: " + Math.round(compositor.memoryManager.itemUsage(surface).total / 1024) + " KiB" : ""; font.pixelSize: 15 }
                 }
             }
         }
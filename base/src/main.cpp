@@ -20,11 +20,11 @@
 #include <QFile>
 #include <QDebug>
 
-#include <glib.h>
-
 #include "weboscompositorpluginloader.h"
 #include "weboscompositorwindow.h"
 #include "weboscorecompositor.h"
+#include "webosstartuptracer.h"
+#include "compositorextensionfactory.h"
 
 #ifdef CURSOR_THEME
 const char* EGLFS_CURSOR_DESCRIPTION = WEBOS_INSTALL_DATADIR "/icons/webos/cursors/cursor.json";
@@ -73,24 +73,10 @@ private:
     WebOSCoreCompositor *m_compositor;
 };
 
-static gboolean deferredDeleter(gpointer data)
-{
-    Q_UNUSED(data)
-
-    /* Process any "deleteLater" objects.
-       QtDeclarative defers to delete some objects including textures from image.
-       Those objects only can be removed when control returns to the event loop.
-       Otherwise we have to call sendPostedEvents(QEvent::DeferredDelete) explicitly.
-       In threaded renderer of QtQuick, there is already some preparation for this.
-       But we are not ready to use the renderer yet.
-       Please refer QObject::"deleteLater" for details. */
-    QCoreApplication::sendPostedEvents(0, QEvent::DeferredDelete);
-
-    return true;
-}
-
 int main(int argc, char *argv[])
 {
+    WebOSStartupTracer::start();
+
 #ifdef CURSOR_THEME
     qputenv("QT_QPA_EGLFS_CURSOR", EGLFS_CURSOR_DESCRIPTION);
 #endif
@@ -99,7 +85,24 @@ int main(int argc, char *argv[])
     // We want the main compositor window to be able to be transparent
     QQuickWindow::setDefaultAlphaBuffer(true);
 
+    // One compositor window per display, each with its own render loop.
+    // Surface textures are shared between their GL contexts.
+    int displays = qMax(1, qEnvironmentVariableIntValue("WEBOS_COMPOSITOR_DISPLAYS"));
+    if (displays > 1)
+        QCoreApplication::setAttribute(Qt::AA_ShareOpenGLContexts);
+
+    // Rendering on a thread of its own keeps animations going while the GUI
+    // thread handles clients. Opt-in as it depends on the platform plugin.
+    // An explicit QSG_RENDER_LOOP is left untouched.
+    if (qEnvironmentVariableIntValue("WEBOS_COMPOSITOR_THREADED_RENDERING") > 0 && !qEnvironmentVariableIsSet("QSG_RENDER_LOOP"))
+        qputenv("QSG_RENDER_LOOP", "threaded");
+
+    WebOSStartupTracer::begin("appCreate");
     QGuiApplication app(argc, argv);
+    WebOSStartupTracer::end("appCreate");
+
+    // Runs while the windows and the compositor are being created
+    CompositorExtensionFactory::preload();
 
     WebOSCompositorWindow *compositorWindow = NULL;
     WebOSCoreCompositor *compositor = NULL;
@@ -107,6 +110,7 @@ int main(int argc, char *argv[])
 
     QString compositorPluginName = QString::fromLocal8Bit(qgetenv("WEBOS_COMPOSITOR_PLUGIN"));
     if (!compositorPluginName.isEmpty()) {
+        WebOSStartupPhase phase("pluginLoad");
         compositorPluginLoader = new WebOSCompositorPluginLoader(compositorPluginName);
         compositorWindow = compositorPluginLoader->compositorWindow();
         compositor = compositorPluginLoader->compositor();
@@ -119,6 +123,7 @@ int main(int argc, char *argv[])
         qInfo() << "Using the extended compositorWindow from the plugin" << compositorPluginName;
     } else {
         qInfo() << "Using WebOSCompositorWindow (default compositor window)";
+        WebOSStartupPhase phase("windowInit");
         compositorWindow = new WebOSCompositorWindow();
     }
 
@@ -126,23 +131,64 @@ int main(int argc, char *argv[])
         qInfo() << "Using the extended compositor from the plugin" << compositorPluginName;
     } else {
         qInfo() << "Using WebOSCoreCompositor (default compositor)";
+        WebOSStartupPhase phase("compositorInit");
         compositor = new WebOSCoreCompositor(compositorWindow, WebOSCoreCompositor::NoExtensions);
     }
 
     compositor->registerTypes();
 
+    // Clients are accepted as soon as the event loop runs, which is before
+    // the QML is loaded. Their surfaces are shown once the views exist.
+    compositor->setViewsReady(false);
+
+    // Compiled on the QML loader thread while the rest is set up
+    const QUrl mainQml("file://" WEBOS_INSTALL_QML "/WebOSCompositorBase/main.qml");
+    const QUrl extraQml("file://" WEBOS_INSTALL_QML "/WebOSCompositorBase/extra.qml");
+    compositorWindow->compileCompositorMain(mainQml);
+
     compositorWindow->setCompositor(compositor);
-    compositorWindow->setCompositorMain(QUrl("file://" WEBOS_INSTALL_QML "/WebOSCompositorBase/main.qml"));
 
-#ifdef UPSTART_SIGNALING
-    compositor->emitLsmReady();
-#endif
+    QList<WebOSCompositorWindow *> extraWindows;
+    for (int displayId = 1; displayId < displays; displayId++) {
+        WebOSStartupPhase phase("extraWindowInit");
+        WebOSCompositorWindow *extraWindow = new WebOSCompositorWindow(QString(), 0, displayId);
+        extraWindow->setCompositor(compositor);
+        extraWindow->compileCompositorMain(extraQml);
+        extraWindows << extraWindow;
+    }
 
-    compositorWindow->installEventFilter(new EventFilter(compositor));
+    compositorWindow->setCompositorMain(mainQml);
+
+    // Dependent services start once there is something on the screen
+    compositor->emitLsmReadyOnFirstFrame();
+
+    foreach (WebOSCompositorWindow *extraWindow, extraWindows)
+        extraWindow->setCompositorMain(extraQml);
+
+    EventFilter *eventFilter = new EventFilter(compositor);
+    compositorWindow->installEventFilter(eventFilter);
+    foreach (WebOSCompositorWindow *extraWindow, extraWindows)
+        extraWindow->installEventFilter(eventFilter);
+
+    // Startup ends with the first frame on the primary display. The window
+    // is given as the context so that this runs on the GUI thread even when
+    // frameSwapped comes from the render thread.
+    const bool dumpTimeline = !qEnvironmentVariableIsEmpty("WEBOS_COMPOSITOR_STARTUP_TRACE");
+    QMetaObject::Connection *firstFrame = new QMetaObject::Connection;
+    *firstFrame = QObject::connect(compositorWindow, &QQuickWindow::frameSwapped, compositorWindow, [compositorWindow, firstFrame, dumpTimeline]() {
+        // Not until the QML is loaded as it may be created asynchronously
+        if (!compositorWindow->rootObject())
+            return;
+        QObject::disconnect(*firstFrame);
+        delete firstFrame;
+        WebOSStartupTracer::mark("firstFrame");
+        if (dumpTimeline)
+            WebOSStartupTracer::dump();
+    });
 
     compositorWindow->showWindow();
-
-    g_timeout_add(10000, (GSourceFunc)deferredDeleter, NULL);
+    foreach (WebOSCompositorWindow *extraWindow, extraWindows)
+        extraWindow->showWindow();
 
     return app.exec();
 }
@@ -26,3 +26,7 @@ SUBDIRS = modules
 compositor_base {
     SUBDIRS += base
 }
+
+tools {
+    SUBDIRS += tools
+}
@@ -16,14 +16,18 @@
 
 #include "compositorextensionfactory.h"
 #include "weboscorecompositor.h"
+#include "webosstartuptracer.h"
 
 #include <compositorextensionplugin.h>
 #include <compositorextension.h>
 
 #include <QDebug>
+#include <QJsonArray>
 #include <QJsonObject>
 #include <QObject>
 #include <QPluginLoader>
+#include <QRunnable>
+#include <QThreadPool>
 #include <QtCore/private/qfactoryloader_p.h>
 #include <QtCore/QCoreApplication>
 #include <QtCore/QDir>
@@ -38,25 +42,85 @@ QFileSystemWatcher CompositorExtensionFactory::m_fileWatcher;
 WebOSCoreCompositor* CompositorExtensionFactory::m_webosCompositor;
 const char* CompositorExtensionFactory::pluginDir = "/tmp/lsm_test_plugin";
 
-QHash<QString, CompositorExtension *> CompositorExtensionFactory::create(WebOSCoreCompositor* compositor)
+Q_GLOBAL_STATIC(QThreadPool, preloadPool)
+
+static bool startupMetaData(const QJsonObject &metaData)
 {
-    QHash<QString, CompositorExtension *> hash;
+    return metaData.value(QStringLiteral("MetaData")).toObject().value(QStringLiteral("Startup")).toBool(true);
+}
 
-    QStringList extensions = QString::fromLocal8Bit(qgetenv("WEBOS_COMPOSITOR_EXTENSIONS")).split(QLatin1String(","), QString::SkipEmptyParts);
+class ExtensionPreloadJob : public QRunnable
+{
+public:
+    void run() Q_DECL_OVERRIDE
+    {
+        WebOSStartupPhase phase("extensionPreload");
+        QStringList extensions = CompositorExtensionFactory::requested();
+
+        // The same lookup as the factory loader does. A library loaded
+        // here stays loaded, so the loader only has to instantiate it.
+        foreach (const QString &path, QCoreApplication::libraryPaths()) {
+            QDir dir(path + QLatin1String("/compositorextensions"));
+            foreach (const QString &fileName, dir.entryList(QDir::Files)) {
+                QPluginLoader plugin(dir.absoluteFilePath(fileName));
+                QJsonObject metaData = plugin.metaData();
+                if (metaData.value(QStringLiteral("IID")).toString() != QLatin1String(CompositorExtensionFactoryInterface_iid))
+                    continue;
+
+                // The others are loaded later on, maybe never
+                if (!startupMetaData(metaData))
+                    continue;
+
+                foreach (const QJsonValue &key, metaData.value(QStringLiteral("MetaData")).toObject().value(QStringLiteral("Keys")).toArray()) {
+                    if (extensions.contains(key.toString(), Qt::CaseInsensitive)) {
+                        if (!plugin.load())
+                            qWarning() << "Failed to preload" << plugin.fileName() << plugin.errorString();
+                        break;
+                    }
+                }
+            }
+        }
+    }
+};
 
-    m_webosCompositor = compositor;
+void CompositorExtensionFactory::preload()
+{
+    if (!requested().isEmpty())
+        preloadPool()->start(new ExtensionPreloadJob);
+}
 
-    qDebug() << "Loading the following plugins" << extensions;
-    for (int i = 0; i < extensions.size(); i++) {
-        CompositorExtension *extension = qLoadPlugin1<CompositorExtension, CompositorExtensionPlugin>(loader(), extensions[i], QStringList());
-        if (!extension)
-            continue;
+QStringList CompositorExtensionFactory::requested()
+{
+    return QString::fromLocal8Bit(qgetenv("WEBOS_COMPOSITOR_EXTENSIONS")).split(QLatin1String(","), QString::SkipEmptyParts);
+}
 
-        initializeExtension(extension);
-        hash[extensions[i]] = extension;
+bool CompositorExtensionFactory::isStartupExtension(const QString &key)
+{
+    // Not to race the preload job, which loads the same plugins through
+    // QPluginLoaders of its own. dlopen itself would not mind.
+    preloadPool()->waitForDone();
+
+    foreach (const QJsonObject &metaData, loader()->metaData()) {
+        foreach (const QJsonValue &k, metaData.value(QStringLiteral("MetaData")).toObject().value(QStringLiteral("Keys")).toArray()) {
+            if (QString::compare(k.toString(), key, Qt::CaseInsensitive) == 0)
+                return startupMetaData(metaData);
+        }
     }
+    return true;
+}
+
+CompositorExtension *CompositorExtensionFactory::create(WebOSCoreCompositor* compositor, const QString &key)
+{
+    preloadPool()->waitForDone();
+
+    m_webosCompositor = compositor;
+
+    qDebug() << "Loading the plugin" << key;
+    CompositorExtension *extension = qLoadPlugin1<CompositorExtension, CompositorExtensionPlugin>(loader(), key, QStringList());
+    if (extension)
+        initializeExtension(extension);
 
-    return hash;
+    return extension;
 }
 
 void CompositorExtensionFactory::watchTestPluginDir()
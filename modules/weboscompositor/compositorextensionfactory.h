@@ -29,7 +29,20 @@ class CompositorExtension;
 class CompositorExtensionFactory
 {
 public:
-    static QHash<QString, CompositorExtension *> create(WebOSCoreCompositor *);
+    /*! Returns the keys listed in WEBOS_COMPOSITOR_EXTENSIONS */
+    static QStringList requested();
+    /*!
+     * Returns whether the extension \a key is needed at startup, as given
+     * by "Startup" in the metadata of its plugin. Defaults to true.
+     */
+    static bool isStartupExtension(const QString &key);
+    static CompositorExtension *create(WebOSCoreCompositor *, const QString &key);
+    /*!
+     * Loads the libraries of the startup extensions on a worker thread,
+     * without instantiating them, so that create() only has to wait for
+     * the rest. To be called as early as possible.
+     */
+    static void preload();
     static void watchTestPluginDir();
 
 private:
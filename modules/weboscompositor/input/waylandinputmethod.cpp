@@ -34,6 +34,14 @@ WaylandInputMethod::WaylandInputMethod(QWaylandCompositor* compositor)
     , m_inputPanel(0)
     , m_inputMethodManager(0)
     , m_allowed(true)
+    , m_surroundingTextMode(SurroundingTextFull)
+    , m_surroundingTextWindow(0)
+    , m_activationContext(0)
+    , m_activationCold(false)
+    , m_activationLatency(-1)
+    , m_activationLatencySum(0)
+    , m_activationCount(0)
+    , m_coldActivationCount(0)
 {
     m_factory = new WaylandTextModelFactory(compositor, this);
     wl_display_add_global(compositor->waylandDisplay(), &input_method_interface, this, WaylandInputMethod::bind);
@@ -42,7 +50,18 @@ WaylandInputMethod::WaylandInputMethod(QWaylandCompositor* compositor)
     m_inputMethodManager = new WaylandInputMethodManager(this);
 
     connect(this, SIGNAL(inputMethodBound(bool)), m_inputMethodManager, SLOT(onInputMethodAvaliable(bool)), Qt::QueuedConnection);
+    connect(m_inputMethodManager, &WaylandInputMethodManager::standbyChanged, this, &WaylandInputMethod::standbyChanged);
+    connect(m_inputPanel, &WaylandInputPanel::inputPanelStateChanged, this, &WaylandInputMethod::onInputPanelStateChanged);
 
+    // Defaults for the surrounding text policy, can be overridden from QML
+    QByteArray mode = qgetenv("WEBOS_COMPOSITOR_IME_SURROUNDING_TEXT_MODE");
+    if (mode == "windowed")
+        m_surroundingTextMode = SurroundingTextWindowed;
+
+    bool ok = false;
+    int window = qEnvironmentVariableIntValue("WEBOS_COMPOSITOR_IME_SURROUNDING_TEXT_WINDOW", &ok);
+    if (ok && window > 0)
+        m_surroundingTextWindow = window;
 }
 
 WaylandInputMethod::~WaylandInputMethod()
@@ -83,12 +102,23 @@ void WaylandInputMethod::contextActivated()
     }
     m_activeContext = context;
     emit inputMethodActivated();
+
+    // The panel may be still up from the previous context
+    if (m_activationContext == context && m_inputPanel->state() == WaylandInputPanel::InputPanelShown)
+        finishActivation();
 }
 
 void WaylandInputMethod::contextDeactivated()
 {
     WaylandInputMethodContext* context = qobject_cast<WaylandInputMethodContext*>(sender());
     qDebug() << m_activeContext << context << sender();
+
+    // Gone before the panel showed up, nothing to measure
+    if (m_activationContext == sender()) {
+        m_activationContext = NULL;
+        m_activationTime.invalidate();
+    }
+
     if (m_activeContext != sender()) {
         return;
     }
@@ -113,3 +143,75 @@ void WaylandInputMethod::setAllowed(bool allowed)
             deactivate();
     }
 }
+
+void WaylandInputMethod::setSurroundingTextMode(SurroundingTextMode mode)
+{
+    if (m_surroundingTextMode != mode) {
+        qDebug() << "surroundingTextMode:" << m_surroundingTextMode << "->" << mode;
+        m_surroundingTextMode = mode;
+        emit surroundingTextModeChanged();
+    }
+}
+
+void WaylandInputMethod::setSurroundingTextWindow(int bytes)
+{
+    if (bytes < 0)
+        bytes = 0;
+
+    if (m_surroundingTextWindow != bytes) {
+        qDebug() << "surroundingTextWindow:" << m_surroundingTextWindow << "->" << bytes;
+        m_surroundingTextWindow = bytes;
+        emit surroundingTextWindowChanged();
+    }
+}
+
+bool WaylandInputMethod::standby() const
+{
+    return m_inputMethodManager->standby();
+}
+
+void WaylandInputMethod::setStandby(bool standby)
+{
+    m_inputMethodManager->setStandby(standby);
+}
+
+int WaylandInputMethod::averageActivationLatency() const
+{
+    return m_activationCount > 0 ? m_activationLatencySum / m_activationCount : -1;
+}
+
+void WaylandInputMethod::activationRequested(WaylandInputMethodContext* context)
+{
+    // Activation deferred until the IME server is up comes here again
+    if (m_activationContext == context && m_activationTime.isValid())
+        return;
+
+    m_activationContext = context;
+    m_activationCold = !m_inputMethodManager->isAvailable();
+    m_activationTime.start();
+}
+
+void WaylandInputMethod::onInputPanelStateChanged(WaylandInputPanel::InputPanelState state)
+{
+    if (state == WaylandInputPanel::InputPanelShown && m_activationContext && m_activationContext == m_activeContext)
+        finishActivation();
+}
+
+void WaylandInputMethod::finishActivation()
+{
+    if (!m_activationTime.isValid())
+        return;
+
+    m_activationLatency = m_activationTime.elapsed();
+    m_activationLatencySum += m_activationLatency;
+    m_activationCount++;
+    if (m_activationCold)
+        m_coldActivationCount++;
+
+    qInfo() << "IME activation latency:" << m_activationLatency << "ms" << (m_activationCold ? "(cold)" : "(warm)")
+            << "average:" << averageActivationLatency() << "ms over" << m_activationCount << "activations";
+
+    m_activationContext = NULL;
+    m_activationTime.invalidate();
+    emit activationMetricsChanged();
+}
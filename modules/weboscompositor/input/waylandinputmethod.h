@@ -18,14 +18,16 @@
 #define WAYLANDINPUTMETHOD_H
 
 #include <QObject>
+#include <QElapsedTimer>
 
 #include <wayland-server.h>
 #include <wayland-input-method-server-protocol.h>
 
+#include "waylandinputpanel.h"
+
 class QWaylandCompositor;
 class WaylandTextModelFactory;
 class WaylandInputMethodContext;
-class WaylandInputPanel;
 class WaylandInputMethodManager;
 /*!
  * Talks with the input method sitting in the VKB
@@ -37,8 +39,28 @@ class WaylandInputMethod : public QObject {
 
     Q_PROPERTY(bool active READ active)
     Q_PROPERTY(bool allowed READ allowed WRITE setAllowed NOTIFY allowedChanged)
+    Q_PROPERTY(SurroundingTextMode surroundingTextMode READ surroundingTextMode WRITE setSurroundingTextMode NOTIFY surroundingTextModeChanged)
+    Q_PROPERTY(int surroundingTextWindow READ surroundingTextWindow WRITE setSurroundingTextWindow NOTIFY surroundingTextWindowChanged)
+    Q_PROPERTY(bool standby READ standby WRITE setStandby NOTIFY standbyChanged)
+    Q_PROPERTY(int activationLatency READ activationLatency NOTIFY activationMetricsChanged)
+    Q_PROPERTY(int averageActivationLatency READ averageActivationLatency NOTIFY activationMetricsChanged)
+    Q_PROPERTY(int activationCount READ activationCount NOTIFY activationMetricsChanged)
+    Q_PROPERTY(int coldActivationCount READ coldActivationCount NOTIFY activationMetricsChanged)
 
 public:
+    /*!
+     * Controls how much of the surrounding text is forwarded to the input method.
+     * SurroundingTextFull        Whole text as given by the client
+     * SurroundingTextWindowed    At most surroundingTextWindow bytes around the cursor
+     * There is no mode sending only what changed, as surrounding_text of the
+     * input method protocol always replaces the whole text it knows.
+     */
+    enum SurroundingTextMode {
+        SurroundingTextFull = 0,
+        SurroundingTextWindowed
+    };
+    Q_ENUM(SurroundingTextMode)
+
     WaylandInputMethod(QWaylandCompositor* compositor);
     ~WaylandInputMethod();
 
@@ -53,6 +75,26 @@ public:
     bool allowed() const { return m_allowed; };
     void setAllowed(bool allowed);
 
+    SurroundingTextMode surroundingTextMode() const { return m_surroundingTextMode; }
+    void setSurroundingTextMode(SurroundingTextMode mode);
+    int surroundingTextWindow() const { return m_surroundingTextWindow; }
+    void setSurroundingTextWindow(int bytes);
+
+    bool standby() const;
+    void setStandby(bool standby);
+
+    /*!
+     * Activation latency is the time from a text model asking for the input
+     * method until the input panel is shown, in milliseconds. A cold
+     * activation is one that had to wait for the IME server to start.
+     */
+    int activationLatency() const { return m_activationLatency; }
+    int averageActivationLatency() const;
+    int activationCount() const { return m_activationCount; }
+    int coldActivationCount() const { return m_coldActivationCount; }
+
+    void activationRequested(WaylandInputMethodContext* context);
+
 public slots:
     void deactivate();
 
@@ -66,8 +108,16 @@ signals:
     void inputMethodBound(bool);
 
     void allowedChanged();
+    void surroundingTextModeChanged();
+    void surroundingTextWindowChanged();
+    void standbyChanged();
+    void activationMetricsChanged();
+
+private slots:
+    void onInputPanelStateChanged(WaylandInputPanel::InputPanelState state);
 
 private:
+    void finishActivation();
 
     QWaylandCompositor* m_compositor;
     WaylandTextModelFactory* m_factory;
@@ -77,6 +127,16 @@ private:
     WaylandInputPanel* m_inputPanel;
     WaylandInputMethodManager* m_inputMethodManager;
     bool m_allowed;
+    SurroundingTextMode m_surroundingTextMode;
+    int m_surroundingTextWindow;
+
+    WaylandInputMethodContext* m_activationContext;
+    QElapsedTimer m_activationTime;
+    bool m_activationCold;
+    int m_activationLatency;
+    qint64 m_activationLatencySum;
+    int m_activationCount;
+    int m_coldActivationCount;
 };
 
 #endif //WAYLANDINPUTMETHOD_H
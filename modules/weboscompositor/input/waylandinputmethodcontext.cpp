@@ -38,6 +38,27 @@
 #include "../webosseat/webosseat.h"
 #endif
 
+// Roughly a frame at 60Hz; surrounding text goes out at most once per interval
+static const int SurroundingTextInterval = 16;
+
+static inline bool isUtf8Continuation(const QByteArray& text, int pos)
+{
+    return pos > 0 && pos < text.size() && (text.at(pos) & 0xC0) == 0x80;
+}
+
+// Computes [begin, end) that covers [lo, hi] plus margin bytes on each side,
+// clamped to the text and widened so that no UTF-8 sequence is split.
+static void surroundingSpan(const QByteArray& text, int lo, int hi, int margin, int& begin, int& end)
+{
+    begin = qMax(0, lo - margin);
+    end = qMin(text.size(), hi + margin);
+
+    while (isUtf8Continuation(text, begin))
+        --begin;
+    while (isUtf8Continuation(text, end))
+        ++end;
+}
+
 const struct input_method_context_interface WaylandInputMethodContext::inputMethodContextImplementation = {
     WaylandInputMethodContext::destroy,
     WaylandInputMethodContext::commitString,
@@ -61,9 +82,24 @@ WaylandInputMethodContext::WaylandInputMethodContext(WaylandInputMethod* inputMe
     , m_grabbed(false)
     , m_activated(false)
     , m_resourceCount(0)
+    , m_surroundingTextPending(false)
+    , m_surroundingCursor(0)
+    , m_surroundingAnchor(0)
+    , m_sentCursor(0)
+    , m_sentAnchor(0)
 {
     qDebug() << this;
 
+    m_surroundingTextTimer.setSingleShot(true);
+    m_surroundingTextTimer.setInterval(SurroundingTextInterval);
+    connect(&m_surroundingTextTimer, &QTimer::timeout, this, &WaylandInputMethodContext::flushSurroundingText);
+
+    // Zero interval: everything the input method sent in the current dispatch
+    // is forwarded together when control returns to the event loop.
+    m_textUpdateTimer.setSingleShot(true);
+    m_textUpdateTimer.setInterval(0);
+    connect(&m_textUpdateTimer, &QTimer::timeout, this, &WaylandInputMethodContext::flushTextUpdate);
+
     connect(model, SIGNAL(activated()), this, SLOT(activateTextModel()));
     connect(model, SIGNAL(deactivated()), this, SLOT(deactivateTextModel()));
     connect(model, SIGNAL(destroyed()), this, SLOT(destroyTextModel()));
@@ -71,8 +107,8 @@ WaylandInputMethodContext::WaylandInputMethodContext(WaylandInputMethod* inputMe
             this, SLOT(updateContentType(uint32_t, uint32_t)));
     connect(model, SIGNAL(enterKeyTypeChanged(uint32_t)),
             this, SLOT(updateEnterKeyType(uint32_t)));
-    connect(model, SIGNAL(surroundingTextChanged(const QString&, uint32_t, uint32_t)),
-            this, SLOT(updateSurroundingText(const QString&, uint32_t, uint32_t)));
+    connect(model, SIGNAL(surroundingTextChanged(const QByteArray&, uint32_t, uint32_t)),
+            this, SLOT(updateSurroundingText(const QByteArray&, uint32_t, uint32_t)));
     connect(model, SIGNAL(reset(uint32_t)), this, SLOT(resetContext(uint32_t)));
     connect(model, SIGNAL(commit()), this, SLOT(commit()));
     connect(model, SIGNAL(actionInvoked(uint32_t, uint32_t)), this, SLOT(invokeAction(uint32_t, uint32_t)));
@@ -91,6 +127,7 @@ void WaylandInputMethodContext::destroyInputMethodContext(struct wl_resource* re
     WaylandTextModel* model = that->m_textModel;
 
     if (model && model->isActive()) {
+        that->flushTextUpdate();
         that->updatePanelState(WaylandInputPanel::InputPanelHidden);
         model->sendLeft();
     }
@@ -115,66 +152,139 @@ void WaylandInputMethodContext::commitString(struct wl_client *client, struct wl
 {
     Q_UNUSED(client);
     WaylandInputMethodContext* that = static_cast<WaylandInputMethodContext*>(resource->data);
-    if (that->m_textModel)
-        that->m_textModel->commitString(serial, text);
+    if (!that->m_textModel)
+        return;
+
+    WaylandTextModelUpdate& u = that->m_textUpdate;
+    // Committed text replaces the preedit, so a preedit before it is never shown.
+    // Consecutive commits are merged since nothing can come in between them.
+    u.preedit.clear();
+    if (u.hasCommit)
+        u.commit.append(text);
+    else
+        u.commit = QByteArray(text);
+    u.hasCommit = true;
+    u.serial = serial;
+    that->scheduleTextUpdate();
 }
 
 void WaylandInputMethodContext::preEditString(struct wl_client *client, struct wl_resource *resource, uint32_t serial, const char *text, const char* commit)
 {
     Q_UNUSED(client);
     WaylandInputMethodContext* that = static_cast<WaylandInputMethodContext*>(resource->data);
-    if (that->m_textModel)
-        that->m_textModel->preEditString(serial, text, commit);
+    if (!that->m_textModel)
+        return;
+
+    WaylandTextModelUpdate& u = that->m_textUpdate;
+    // The latest preedit along with its staged styling wins
+    u.preedit = u.staged;
+    u.preedit.hasText = true;
+    u.preedit.text = QByteArray(text);
+    u.preedit.commit = QByteArray(commit);
+    u.staged.clear();
+    u.serial = serial;
+    that->scheduleTextUpdate();
 }
 
 void WaylandInputMethodContext::preEditStyling(struct wl_client *client, struct wl_resource *resource, uint32_t serial, uint32_t index, uint32_t length, uint32_t style)
 {
     Q_UNUSED(client);
     WaylandInputMethodContext* that = static_cast<WaylandInputMethodContext*>(resource->data);
-    if (that->m_textModel)
-        that->m_textModel->preEditStyling(serial, index, length, style);
+    if (!that->m_textModel)
+        return;
+
+    WaylandTextModelUpdate::PreeditStyle s = { index, length, style };
+    that->m_textUpdate.staged.styles << s;
+    that->m_textUpdate.serial = serial;
+    that->scheduleTextUpdate();
 }
 
 void WaylandInputMethodContext::preEditCursor(struct wl_client *client, struct wl_resource *resource, uint32_t serial, int32_t index)
 {
     Q_UNUSED(client);
     WaylandInputMethodContext* that = static_cast<WaylandInputMethodContext*>(resource->data);
-    if (that->m_textModel)
-        that->m_textModel->preEditCursor(serial, index);
+    if (!that->m_textModel)
+        return;
+
+    that->m_textUpdate.staged.hasCursor = true;
+    that->m_textUpdate.staged.cursor = index;
+    that->m_textUpdate.serial = serial;
+    that->scheduleTextUpdate();
 }
 
 void WaylandInputMethodContext::deleteSurroundingText(struct wl_client *client, struct wl_resource *resource, uint32_t serial, int32_t index, uint32_t length)
 {
     Q_UNUSED(client);
     WaylandInputMethodContext* that = static_cast<WaylandInputMethodContext*>(resource->data);
-    if (that->m_textModel)
-        that->m_textModel->deleteSurroundingText(serial, index, length);
+    if (!that->m_textModel)
+        return;
+
+    // Applies to the next commit_string, so it cannot be merged into a batch
+    // that already has a commit or a deletion of its own.
+    if (that->m_textUpdate.hasCommit || that->m_textUpdate.hasDelete)
+        that->flushTextUpdate();
+
+    that->m_textUpdate.hasDelete = true;
+    that->m_textUpdate.deleteIndex = index;
+    that->m_textUpdate.deleteLength = length;
+    that->m_textUpdate.serial = serial;
+    that->scheduleTextUpdate();
 }
 
 void WaylandInputMethodContext::cursorPosition(struct wl_client *client, struct wl_resource *resource, uint32_t serial, int32_t index, int32_t anchor)
 {
     Q_UNUSED(client);
     WaylandInputMethodContext* that = static_cast<WaylandInputMethodContext*>(resource->data);
-    if (that->m_textModel)
-        that->m_textModel->cursorPosition(serial, index, anchor);
+    if (!that->m_textModel)
+        return;
+
+    // Same as deleteSurroundingText, applies to the next commit_string
+    if (that->m_textUpdate.hasCommit)
+        that->flushTextUpdate();
+
+    that->m_textUpdate.hasCursorPosition = true;
+    that->m_textUpdate.cursorIndex = index;
+    that->m_textUpdate.cursorAnchor = anchor;
+    that->m_textUpdate.serial = serial;
+    that->scheduleTextUpdate();
 }
 
 void WaylandInputMethodContext::modifiersMap(struct wl_client *client, struct wl_resource *resource, struct wl_array *map)
 {
     Q_UNUSED(client);
     WaylandInputMethodContext* that = static_cast<WaylandInputMethodContext*>(resource->data);
-    if (that->m_textModel)
+    if (that->m_textModel) {
+        that->flushTextUpdate();
         that->m_textModel->modifiersMap(map);
+    }
 }
 
 void WaylandInputMethodContext::keySym(struct wl_client *client, struct wl_resource *resource, uint32_t serial, uint32_t time, uint32_t sym, uint32_t state, uint32_t modifiers)
 {
     Q_UNUSED(client);
     WaylandInputMethodContext* that = static_cast<WaylandInputMethodContext*>(resource->data);
-    if (that->m_textModel)
+    if (that->m_textModel) {
+        // Keep the key ordered after the text the input method sent before it
+        that->flushTextUpdate();
         text_model_send_keysym(that->m_textModel->handle(), serial, time, sym, state, modifiers);
+    }
 }
 
+void WaylandInputMethodContext::scheduleTextUpdate()
+{
+    if (!m_textUpdateTimer.isActive())
+        m_textUpdateTimer.start();
+}
+
+void WaylandInputMethodContext::flushTextUpdate()
+{
+    m_textUpdateTimer.stop();
+
+    if (m_textModel && !m_textUpdate.isEmpty())
+        m_textModel->sendUpdate(m_textUpdate);
+
+    m_textUpdate.clear();
+}
 
 void WaylandInputMethodContext::grabKeyboard(struct wl_client *client, struct wl_resource *resource, uint32_t id)
 {
@@ -256,6 +366,7 @@ void WaylandInputMethodContext::deactivate()
 {
     qDebug() << "model" << m_textModel;
     if (m_textModel && m_textModel->isActive()) {
+        flushTextUpdate();
         cleanup();
         updatePanelState(WaylandInputPanel::InputPanelHidden);
         m_textModel->sendLeft();
@@ -282,6 +393,8 @@ void WaylandInputMethodContext::activateTextModel()
 {
     qDebug() << "model" << m_textModel;
 
+    m_inputMethod->activationRequested(this);
+
     if (!m_inputMethod->inputMethodManager()->requestInputMethod()) {
         connect(m_inputMethod->inputMethodManager(), SIGNAL(inputMethodAvaliable()),
                 this, SLOT(continueTextModelActivation()),
@@ -301,6 +414,9 @@ void WaylandInputMethodContext::activateTextModel()
         m_inputMethod->deactivate();
     }
 
+    // A new context resource starts without any surrounding text
+    resetSurroundingText();
+
     m_resourceCount++;
     m_resource = (wl_resource*)calloc(1, sizeof(wl_resource));
     m_resource->destroy = WaylandInputMethodContext::destroyInputMethodContext;
@@ -332,6 +448,7 @@ void WaylandInputMethodContext::deactivateTextModel()
 {
     WaylandTextModel* textModel = qobject_cast<WaylandTextModel*>(sender());
     qDebug() << "model" << textModel;
+    flushTextUpdate();
     cleanup();
 }
 
@@ -340,6 +457,8 @@ void WaylandInputMethodContext::destroyTextModel()
     WaylandTextModel* textModel = qobject_cast<WaylandTextModel*>(sender());
     qDebug() << "model" << textModel;
     m_textModel = NULL;
+    // Nothing to deliver the pending text to anymore
+    flushTextUpdate();
     cleanup();
 
     maybeDestroy();
@@ -361,16 +480,89 @@ void WaylandInputMethodContext::updateEnterKeyType(uint32_t enter_key_type)
     }
 }
 
-void WaylandInputMethodContext::updateSurroundingText(const QString& text, uint32_t cursor, uint32_t anchor)
+void WaylandInputMethodContext::updateSurroundingText(const QByteArray& text, uint32_t cursor, uint32_t anchor)
 {
-    if (m_resource) {
-        input_method_context_send_surrounding_text(m_resource, text.toUtf8().data(), cursor, anchor);
+    if (!m_resource)
+        return;
+
+    m_surroundingText = text;
+    m_surroundingCursor = cursor;
+    m_surroundingAnchor = anchor;
+    m_surroundingTextPending = true;
+
+    // Send right away unless something already went out within this frame,
+    // in which case the latest text is flushed when the interval expires.
+    if (!m_surroundingTextTimer.isActive())
+        flushSurroundingText();
+}
+
+void WaylandInputMethodContext::flushSurroundingText()
+{
+    if (!m_surroundingTextPending)
+        return;
+
+    sendPendingSurroundingText();
+    m_surroundingTextTimer.start();
+}
+
+void WaylandInputMethodContext::sendPendingSurroundingText()
+{
+    m_surroundingTextPending = false;
+
+    if (!m_resource)
+        return;
+
+    const QByteArray& text = m_surroundingText;
+    int size = text.size();
+    int cursor = (int) qMin<uint32_t>(m_surroundingCursor, size);
+    int anchor = (int) qMin<uint32_t>(m_surroundingAnchor, size);
+    int window = m_inputMethod->surroundingTextWindow();
+    int begin = 0;
+    int end = size;
+
+    switch (m_inputMethod->surroundingTextMode()) {
+    case WaylandInputMethod::SurroundingTextWindowed:
+        if (window > 0 && size > window) {
+            int lo = qMin(cursor, anchor);
+            int hi = qMax(cursor, anchor);
+            // Keep the cursor centered if the selection does not fit
+            if (hi - lo >= window)
+                lo = hi = cursor;
+            surroundingSpan(text, lo, hi, (window - (hi - lo)) / 2, begin, end);
+        }
+        break;
+    default:
+        break;
     }
+
+    QByteArray span = (begin == 0 && end == size) ? text : text.mid(begin, end - begin);
+    uint32_t spanCursor = qBound(begin, cursor, end) - begin;
+    uint32_t spanAnchor = qBound(begin, anchor, end) - begin;
+
+    if (!m_sentText.isNull() && span == m_sentText && spanCursor == m_sentCursor && spanAnchor == m_sentAnchor)
+        return;
+
+    m_sentText = span;
+    m_sentCursor = spanCursor;
+    m_sentAnchor = spanAnchor;
+    input_method_context_send_surrounding_text(m_resource, span.constData(), spanCursor, spanAnchor);
+}
+
+void WaylandInputMethodContext::resetSurroundingText()
+{
+    m_surroundingTextTimer.stop();
+    m_surroundingTextPending = false;
+    m_surroundingText.clear();
+    m_sentText = QByteArray();
+    m_sentCursor = m_sentAnchor = 0;
 }
 
 void WaylandInputMethodContext::resetContext(uint32_t serial)
 {
     if (m_resource) {
+        // The input method has to see the latest text before these
+        if (m_surroundingTextPending)
+            sendPendingSurroundingText();
         input_method_context_send_reset(m_resource, serial);
     }
 }
@@ -378,6 +570,8 @@ void WaylandInputMethodContext::resetContext(uint32_t serial)
 void WaylandInputMethodContext::commit()
 {
     if (m_resource) {
+        if (m_surroundingTextPending)
+            sendPendingSurroundingText();
         input_method_context_send_commit(m_resource);
     }
 }
@@ -385,6 +579,8 @@ void WaylandInputMethodContext::commit()
 void WaylandInputMethodContext::invokeAction(uint32_t button, uint32_t index)
 {
     if (m_resource) {
+        if (m_surroundingTextPending)
+            sendPendingSurroundingText();
         input_method_context_send_invoke_action(m_resource, button, index);
     }
 }
@@ -408,6 +604,8 @@ void WaylandInputMethodContext::cleanup()
     disconnect(m_inputMethod->inputMethodManager(), SIGNAL(inputMethodAvaliable()),
         this, SLOT(continueTextModelActivation()));
 
+    resetSurroundingText();
+
     /* Prevent from sending deactivate repeatedly. Otherwise client can be stuck
        after reqeust to destroy input_method_context. */
     if (!m_activated)
@@ -19,15 +19,17 @@
 
 #include <QObject>
 #include <QRect>
+#include <QTimer>
+#include <QByteArray>
 
 #include <wayland-server.h>
 #include <wayland-input-method-server-protocol.h>
 #include <wayland-text-server-protocol.h>
 #include <QtCompositor/private/qwlkeyboard_p.h>
 #include "waylandinputpanel.h"
+#include "waylandtextmodel.h"
 
 class WaylandInputMethod;
-class WaylandTextModel;
 
 /*!
  * Implements the compositor side protocol for the input method
@@ -70,7 +72,7 @@ public slots:
     void destroyTextModel();
     void updateContentType(uint32_t hint, uint32_t purpose);
     void updateEnterKeyType(uint32_t enter_key_type);
-    void updateSurroundingText(const QString& text, uint32_t cursor, uint32_t anchor);
+    void updateSurroundingText(const QByteArray& text, uint32_t cursor, uint32_t anchor);
     void resetContext(uint32_t serial);
     void commit();
     void invokeAction(uint32_t button, uint32_t index);
@@ -86,6 +88,10 @@ public slots:
     void updatePanelSize(const QRect &rect) const;
     void continueTextModelActivation();
 
+private slots:
+    void flushSurroundingText();
+    void flushTextUpdate();
+
 Q_SIGNALS:
     void contextDestroyed();
     void activated();
@@ -99,6 +105,11 @@ private:
     void grabKeyboardImpl();
     void releaseGrabImpl();
 
+    void sendPendingSurroundingText();
+    void resetSurroundingText();
+
+    void scheduleTextUpdate();
+
     WaylandInputMethod* m_inputMethod;
     WaylandTextModel* m_textModel;
     wl_resource* m_resource;
@@ -106,6 +117,21 @@ private:
     bool m_activated;
     uint32_t m_resourceCount;
     bool m_grabbed;
+
+    // Surrounding text is throttled to one update per frame interval
+    QTimer m_surroundingTextTimer;
+    bool m_surroundingTextPending;
+    QByteArray m_surroundingText;
+    uint32_t m_surroundingCursor;
+    uint32_t m_surroundingAnchor;
+    // What the input method has actually received
+    QByteArray m_sentText;
+    uint32_t m_sentCursor;
+    uint32_t m_sentAnchor;
+
+    // Text changes from the input method, forwarded once per dispatch
+    WaylandTextModelUpdate m_textUpdate;
+    QTimer m_textUpdateTimer;
 };
 
 #endif //WAYLANDINPUTMETHOD_H
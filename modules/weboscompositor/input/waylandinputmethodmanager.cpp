@@ -18,11 +18,25 @@
 #include "waylandinputmethod.h"
 #include <assert.h>
 #include <QProcess>
+#include <QDebug>
+
+// A launch not answered by a bind within this time is considered lost
+static const qint64 LaunchTimeout = 10000;
+// Delay before restarting the IME server in standby mode
+static const int RelaunchDelay = 1000;
 
 WaylandInputMethodManager::WaylandInputMethodManager(QObject* parent)
     : QObject(parent)
     , m_inputMethodAvaliable(false)
+    , m_standby(qEnvironmentVariableIntValue("WEBOS_COMPOSITOR_IME_STANDBY") > 0)
 {
+    m_relaunchTimer.setSingleShot(true);
+    m_relaunchTimer.setInterval(RelaunchDelay);
+    connect(&m_relaunchTimer, &QTimer::timeout, this, &WaylandInputMethodManager::launchInputMethod);
+
+    // Start it once the event loop is running
+    if (m_standby)
+        QMetaObject::invokeMethod(this, "launchInputMethod", Qt::QueuedConnection);
 }
 
 WaylandInputMethodManager::~WaylandInputMethodManager()
@@ -34,9 +48,37 @@ bool WaylandInputMethodManager::requestInputMethod()
     if (m_inputMethodAvaliable)
         return true;
 
+    launchInputMethod();
+    return false;
+}
+
+void WaylandInputMethodManager::setStandby(bool standby)
+{
+    if (m_standby != standby) {
+        qInfo() << "IME standby:" << m_standby << "->" << standby;
+        m_standby = standby;
+        emit standbyChanged();
+
+        if (m_standby)
+            launchInputMethod();
+        else
+            m_relaunchTimer.stop();
+    }
+}
+
+void WaylandInputMethodManager::launchInputMethod()
+{
+    if (m_inputMethodAvaliable)
+        return;
+
+    // Do not pile up launch requests while one is in progress
+    if (m_launchTime.isValid() && m_launchTime.elapsed() < LaunchTimeout)
+        return;
+
+    qInfo() << "Launching IME server, standby:" << m_standby;
     QString upstartCmd = QLatin1String("/sbin/initctl emit ime-activate");
     QProcess::startDetached(upstartCmd);
-    return false;
+    m_launchTime.start();
 }
 
 void WaylandInputMethodManager::onInputMethodAvaliable(bool i_avaliable)
@@ -45,6 +87,15 @@ void WaylandInputMethodManager::onInputMethodAvaliable(bool i_avaliable)
         return;
 
     m_inputMethodAvaliable = i_avaliable;
-    if (i_avaliable)
+    if (i_avaliable) {
+        if (m_launchTime.isValid()) {
+            qInfo() << "IME server bound in" << m_launchTime.elapsed() << "ms";
+            m_launchTime.invalidate();
+        }
+        m_relaunchTimer.stop();
         emit inputMethodAvaliable();
+    } else if (m_standby) {
+        qInfo() << "IME server is gone, relaunching in" << RelaunchDelay << "ms";
+        m_relaunchTimer.start();
+    }
 }
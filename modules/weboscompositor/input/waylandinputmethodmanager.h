@@ -18,10 +18,16 @@
 #define WAYLANDINPUTMETHODMANAGER_H
 
 #include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
 
 class WaylandInputMethod;
 /*!
  * Control is IME server started (Currently MaliitServer), and start it if it's needed.
+ *
+ * In standby mode the IME server is started ahead of the first request and
+ * restarted whenever it goes away, so that activating a text model does not
+ * have to wait for the server to come up.
  */
 class WaylandInputMethodManager : public QObject
 {
@@ -31,13 +37,25 @@ public:
     ~WaylandInputMethodManager();
     bool requestInputMethod();
 
+    bool isAvailable() const { return m_inputMethodAvaliable; }
+    bool standby() const { return m_standby; }
+    void setStandby(bool standby);
+
 public Q_SLOTS:
     void onInputMethodAvaliable(bool i_avaliable);
 Q_SIGNALS:
     void inputMethodAvaliable();
+    void standbyChanged();
+
+private Q_SLOTS:
+    void launchInputMethod();
 
 private:
     bool m_inputMethodAvaliable;
+    bool m_standby;
+    // Valid while a launch is in progress
+    QElapsedTimer m_launchTime;
+    QTimer m_relaunchTimer;
 };
 
 #endif //WAYLANDINPUTMETHODMANAGER_H
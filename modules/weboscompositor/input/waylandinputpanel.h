@@ -84,6 +84,7 @@ public:
     static const struct input_panel_interface inputPanelImplementation;
 
     WaylandInputPanelSurface* activePanelSurface() { return m_activeSurface; }
+    InputPanelState state() const { return m_state; }
 
 signals:
     void inputPanelStateChanged(InputPanelState state);
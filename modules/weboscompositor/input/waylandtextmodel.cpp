@@ -100,6 +100,32 @@ void WaylandTextModel::keySym(uint32_t serial, uint32_t time, uint32_t sym, uint
     text_model_send_keysym(m_resource, serial, time, sym, state, modifiers);
 }
 
+void WaylandTextModel::sendUpdate(const WaylandTextModelUpdate& update)
+{
+    if (update.isEmpty())
+        return;
+
+    uint32_t serial = update.serial;
+
+    // delete_surrounding_text and cursor_position take effect on the next commit_string
+    if (update.hasDelete)
+        deleteSurroundingText(serial, update.deleteIndex, update.deleteLength);
+    if (update.hasCursorPosition)
+        cursorPosition(serial, update.cursorIndex, update.cursorAnchor);
+    if (update.hasCommit)
+        commitString(serial, update.commit.constData());
+
+    const WaylandTextModelUpdate::Preedit* blocks[] = { &update.preedit, &update.staged };
+    for (const WaylandTextModelUpdate::Preedit* p : blocks) {
+        foreach (const WaylandTextModelUpdate::PreeditStyle& s, p->styles)
+            preEditStyling(serial, s.index, s.length, s.style);
+        if (p->hasCursor)
+            preEditCursor(serial, p->cursor);
+        if (p->hasText)
+            preEditString(serial, p->text.constData(), p->commit.constData());
+    }
+}
+
 void WaylandTextModel::sendEntered()
 {
     text_model_send_enter(m_resource, m_surface);
@@ -124,8 +150,9 @@ void WaylandTextModel::sendInputPanelRect(const QRect& geometry) const
 void WaylandTextModel::textModelSetSurroundingText(struct wl_client *client, struct wl_resource *resource, const char *text, uint32_t cursor, uint32_t anchor)
 {
     WaylandTextModel* that = static_cast<WaylandTextModel*>(resource->data);
-    emit that->surroundingTextChanged(QString(text), cursor, anchor);
-
+    // Keep the text as UTF-8 bytes since cursor and anchor are byte offsets
+    // and the input method context forwards it in the same encoding.
+    emit that->surroundingTextChanged(QByteArray(text), cursor, anchor);
 }
 
 void WaylandTextModel::textModelActivate(struct wl_client *client, struct wl_resource *resource, uint32_t serial, struct wl_resource *seat, struct wl_resource *surface)
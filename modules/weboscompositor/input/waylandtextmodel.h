@@ -18,6 +18,8 @@
 #define WAYLANDTEXTMODEL_H
 
 #include <QObject>
+#include <QByteArray>
+#include <QVector>
 
 #include <wayland-server.h>
 #include <wayland-text-server-protocol.h>
@@ -26,6 +28,73 @@
 
 class WaylandInputMethodContext;
 
+/*!
+ * Text changes from the input method collected over one dispatch.
+ *
+ * Only the latest preedit survives, a commit string supersedes the preedit
+ * before it, and WaylandTextModel::sendUpdate emits everything in protocol
+ * order so that the client lays out its text once per update.
+ */
+struct WaylandTextModelUpdate {
+    struct PreeditStyle {
+        uint32_t index;
+        uint32_t length;
+        uint32_t style;
+    };
+
+    struct Preedit {
+        QVector<PreeditStyle> styles;
+        bool hasCursor;
+        int32_t cursor;
+        bool hasText;
+        QByteArray text;
+        QByteArray commit;
+
+        Preedit() { clear(); }
+        void clear() { styles.clear(); hasCursor = false; cursor = 0; hasText = false; text.clear(); commit.clear(); }
+        bool isEmpty() const { return styles.isEmpty() && !hasCursor && !hasText; }
+    };
+
+    uint32_t serial;
+
+    bool hasDelete;
+    int32_t deleteIndex;
+    uint32_t deleteLength;
+
+    bool hasCursorPosition;
+    int32_t cursorIndex;
+    int32_t cursorAnchor;
+
+    bool hasCommit;
+    QByteArray commit;
+
+    // Preedit completed by preedit_string
+    Preedit preedit;
+    // Styling and cursor waiting for the next preedit_string
+    Preedit staged;
+
+    WaylandTextModelUpdate() { clear(); }
+
+    void clear()
+    {
+        serial = 0;
+        hasDelete = false;
+        deleteIndex = 0;
+        deleteLength = 0;
+        hasCursorPosition = false;
+        cursorIndex = cursorAnchor = 0;
+        hasCommit = false;
+        commit.clear();
+        preedit.clear();
+        staged.clear();
+    }
+
+    bool isEmpty() const
+    {
+        return !hasDelete && !hasCursorPosition && !hasCommit && preedit.isEmpty() && staged.isEmpty();
+    }
+};
+
 class WaylandTextModel : public QObject {
 
     Q_OBJECT
@@ -42,6 +111,7 @@ public:
     void cursorPosition(uint32_t serial, int32_t index, int32_t anchor);
     void modifiersMap(struct wl_array *map);
     void keySym(uint32_t serial, uint32_t time, uint32_t sym, uint32_t state, uint32_t modifiers);
+    void sendUpdate(const WaylandTextModelUpdate& update);
 
     void sendEntered();
     void sendLeft();
@@ -80,7 +150,7 @@ Q_SIGNALS:
     void reset(uint32_t serial);
     void contentTypeChanged(uint32_t hint, uint32_t purpose);
     void enterKeyTypeChanged(uint32_t enter_key_type);
-    void surroundingTextChanged(const QString& text, uint32_t cursor, uint32_t anchor);
+    void surroundingTextChanged(const QByteArray& text, uint32_t cursor, uint32_t anchor);
     void commit();
     void actionInvoked(uint32_t button, uint32_t index);
     void maxTextLengthChanged(uint32_t length);
@@ -18,6 +18,8 @@
 #include "weboscorecompositor.h"
 
 #include <QDebug>
+#include <QHash>
+#include <QMetaProperty>
 #include <QWaylandCompositor>
 #include <QWaylandSurface>
 #include <QtCompositor/private/qwlsurface_p.h>
@@ -85,6 +87,7 @@ WebOSShellSurface::WebOSShellSurface(struct wl_client* client, uint32_t id, WebO
     , m_state(Qt::WindowNoState)
     , m_preparedState(Qt::WindowNoState)
     , m_owner(owner)
+    , m_flushScheduled(false)
     , m_surface(surface)
 {
     m_shellSurface = wl_client_add_object(client, &wl_webos_shell_surface_interface, &shell_surface_interface, id, this);
@@ -224,7 +227,72 @@ void WebOSShellSurface::setProperty(const QString &name, const QVariant &value,
         m_properties.insert(name, value);
 
     if (notify)
-        emit propertiesChanged(m_properties, name, value);
+        emit propertiesChanged(m_properties, QStringList(name));
+}
+
+void WebOSShellSurface::setProperties(const QVariantMap &properties)
+{
+    QStringList changed;
+    for (QVariantMap::const_iterator it = properties.constBegin(); it != properties.constEnd(); ++it) {
+        QVariantMap::iterator current = m_properties.find(it.key());
+        if (it.value().isNull()) {
+            if (current == m_properties.end())
+                continue;
+            m_properties.erase(current);
+        } else if (current == m_properties.end()) {
+            m_properties.insert(it.key(), it.value());
+        } else if (current.value() != it.value()) {
+            current.value() = it.value();
+        } else {
+            continue;
+        }
+        changed << it.key();
+    }
+
+    if (changed.isEmpty())
+        return;
+
+    qDebug() << "properties changed" << changed << m_surface << m_surface->appId();
+    emit propertiesChanged(m_properties, changed);
+
+    foreach (const QString &key, changed)
+        emitSurfaceConvenienceSignal(key);
+}
+
+void WebOSShellSurface::flushProperties()
+{
+    m_flushScheduled = false;
+    if (m_pendingProperties.isEmpty())
+        return;
+
+    QVariantMap properties;
+    properties.swap(m_pendingProperties);
+    setProperties(properties);
+}
+
+/*!
+ * Converts the string sent by the client to the type of the property.
+ * Properties of no known type are kept as strings.
+ */
+static QVariant windowPropertyValue(const QString &key, const char *value)
+{
+    static QHash<QString, QVariant::Type> types;
+    if (types.isEmpty()) {
+        types.insert(QStringLiteral("_WEBOS_WINDOW_CLASS"), QVariant::Int);
+        types.insert(QStringLiteral("displayAffinity"), QVariant::Int);
+    }
+
+    QVariant string(QString::fromUtf8(value));
+    QVariant::Type type = types.value(key, QVariant::String);
+    if (type == QVariant::String)
+        return string;
+
+    QVariant typed(string);
+    if (!typed.convert(type)) {
+        qWarning() << "Keeping invalid value of" << key << "as string:" << string;
+        return string;
+    }
+    return typed;
 }
 
 void WebOSShellSurface::set_property(struct wl_client *client, struct wl_resource *resource, const char *name, const char *value)
@@ -232,23 +300,34 @@ void WebOSShellSurface::set_property(struct wl_client *client, struct wl_resourc
     Q_UNUSED(client);
     WebOSShellSurface* that = static_cast<WebOSShellSurface*>(resource->data);
     QString key = QString::fromLatin1(name);
-    QVariant newValue = QVariant(QString::fromUtf8(value));
-    bool emitChange = that->property(key) != newValue;
-    qDebug() << "set property (" << QString::fromLatin1(name) << "," << QVariant(QString::fromUtf8(value)) << ")"
-                 << that->m_surface << that->m_surface->appId();
-    that->setProperty(QString::fromLatin1(name), QVariant(QString::fromUtf8(value)));
-    if (emitChange) {
-        that->emitSurfaceConvenienceSignal(key);
+    QVariant newValue = windowPropertyValue(key, value);
+    qDebug() << "set property (" << key << "," << newValue << ")" << that->m_surface << that->m_surface->appId();
+
+    // Clients send their properties one after another, apply them together
+    // once the requests read along with this one have been dispatched
+    that->m_pendingProperties.insert(key, newValue);
+    if (!that->m_flushScheduled) {
+        that->m_flushScheduled = true;
+        QMetaObject::invokeMethod(that, "flushProperties", Qt::QueuedConnection);
     }
 }
 
 void WebOSShellSurface::emitSurfaceConvenienceSignal(const QString& key)
 {
+    // Notify signal index by property name, -1 if there is none
+    static QHash<const QMetaObject *, QHash<QString, int> > notifySignals;
+
     const QMetaObject* mo = m_surface->metaObject();
-    int propertyIndex = mo->indexOfProperty(key.toLatin1().data());
-    QMetaProperty property = mo->property(propertyIndex);
-    if (property.isValid() && property.hasNotifySignal()) {
-        QMetaMethod signal = property.notifySignal();
+    QHash<QString, int> &cache = notifySignals[mo];
+    QHash<QString, int>::const_iterator cached = cache.constFind(key);
+    if (cached == cache.constEnd()) {
+        QMetaProperty property = mo->property(mo->indexOfProperty(key.toLatin1().constData()));
+        int index = property.isValid() && property.hasNotifySignal() ? property.notifySignalIndex() : -1;
+        cached = cache.insert(key, index);
+    }
+
+    if (cached.value() >= 0) {
+        QMetaMethod signal = mo->method(cached.value());
         qDebug() << "emit" << signal.name();
         signal.invoke(m_surface);
     }
@@ -21,6 +21,7 @@
 
 #include <QObject>
 #include <QMap>
+#include <QStringList>
 #include <wayland-server.h>
 #include <wayland-webos-shell-server-protocol.h>
 
@@ -70,17 +71,29 @@ public:
     QVariantMap properties() const;
     QVariant property(const QString &propertyName) const;
     void setProperty(const QString &name, const QVariant &value, bool notify = true);
+    /*!
+     * Applies all of \a properties at once and emits propertiesChanged a
+     * single time with the names of those that changed, if any. A null
+     * value removes the property.
+     */
+    void setProperties(const QVariantMap &properties);
 
     static const struct wl_webos_shell_surface_interface shell_surface_interface;
 
 public slots:
     void exposed(const QRegion& region);
+    /*!
+     * Applies the properties set by the client so far as one batch. Done
+     * once the requests at hand have been dispatched, or before the
+     * surface is mapped so that it is mapped with them.
+     */
+    void flushProperties();
 
 signals:
     void locationHintChanged();
     void keyMaskChanged();
     void stateChangeRequested(Qt::WindowState s);
-    void propertiesChanged(const QVariantMap &properties, const QString &name, const QVariant &value);
+    void propertiesChanged(const QVariantMap &properties, const QStringList &changed);
 
 private:
     wl_resource* m_shellSurface;
@@ -90,6 +103,9 @@ private:
     Qt::WindowState m_preparedState;
     wl_resource* m_owner;
     QVariantMap m_properties;
+    /*! Set by the client, not applied yet */
+    QVariantMap m_pendingProperties;
+    bool m_flushScheduled;
     QRegion m_exposed;
     WebOSSurfaceItem* m_surface;
 
@@ -105,7 +121,8 @@ private:
     /*!
      * Emits the signal if the given Q_PROPERTY definition exists and if it has
      * a NOTIFY signal assigned to it. Used by WebOSShellSurface to emit quick
-     * access property signal for certain window properties.
+     * access property signal for certain window properties. The lookups are
+     * cached per class.
      */
     void emitSurfaceConvenienceSignal(const QString& property);
 };
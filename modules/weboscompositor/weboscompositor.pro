@@ -50,6 +50,9 @@ HEADERS += \
     webossurfacemodel.h \
     webossurfaceitem.h \
     webosscreenshot.h \
+    webosmemorymanager.h \
+    webossnapshotcache.h \
+    webosstartuptracer.h \
     weboskeyfilter.h \
     compositorextensionfactory.h \
     unixsignalhandler.h
@@ -64,6 +67,9 @@ SOURCES += \
     webossurfacemodel.cpp \
     webossurfaceitem.cpp \
     webosscreenshot.cpp \
+    webosmemorymanager.cpp \
+    webossnapshotcache.cpp \
+    webosstartuptracer.cpp \
     weboskeyfilter.cpp \
     compositorextensionfactory.cpp \
     unixsignalhandler.cpp
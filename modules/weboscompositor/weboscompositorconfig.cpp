@@ -15,18 +15,154 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "weboscompositorconfig.h"
+#include "webosstartuptracer.h"
 
+#include <QDebug>
+#include <QDateTime>
+#include <QFileInfo>
 #include <QJsonDocument>
+#include <QQmlPropertyMap>
+#include <QRunnable>
+#include <QSaveFile>
 #include <QStringList>
 #include <QVariantMap>
 
+#include <sys/stat.h>
+#include <unistd.h>
+
+class ConfigLoadJob : public QRunnable
+{
+public:
+    ConfigLoadJob(WebOSCompositorConfig *config) : m_config(config) {}
+    void run() Q_DECL_OVERRIDE { m_config->doLoad(); }
+private:
+    WebOSCompositorConfig *m_config;
+};
+
+static QString cachePath()
+{
+    // Empty to disable the cache
+    if (qEnvironmentVariableIsSet("WEBOS_COMPOSITOR_CONFIG_CACHE"))
+        return QString::fromLocal8Bit(qgetenv("WEBOS_COMPOSITOR_CONFIG_CACHE"));
+
+    // Only in a directory of our own. Anyone could plant one in /tmp.
+    QString dir = QString::fromLocal8Bit(qgetenv("XDG_RUNTIME_DIR"));
+    if (dir.isEmpty())
+        return QString();
+    return dir + QLatin1String("/lsm-config.cache");
+}
+
+// What the cache was made from, a missing file counts as well
+static QJsonArray sourceStamps(const QStringList& configFiles)
+{
+    QJsonArray sources;
+    foreach (const QString& path, configFiles) {
+        QFileInfo info(path);
+        QJsonObject source;
+        source[QStringLiteral("path")] = path;
+        source[QStringLiteral("mtime")] = info.exists() ? double(info.lastModified().toMSecsSinceEpoch()) : -1.0;
+        source[QStringLiteral("size")] = info.exists() ? double(info.size()) : -1.0;
+        sources.append(source);
+    }
+    return sources;
+}
+
+static QVariant toPropertyValue(QQmlPropertyMap* parent, const QJsonValue& value);
+
+static void fillPropertyMap(QQmlPropertyMap* map, const QJsonObject& object)
+{
+    for (QJsonObject::const_iterator it = object.constBegin(); it != object.constEnd(); ++it)
+        map->insert(it.key(), toPropertyValue(map, it.value()));
+}
+
+static QVariant toPropertyValue(QQmlPropertyMap* parent, const QJsonValue& value)
+{
+    if (!value.isObject())
+        return value.toVariant();
+
+    QQmlPropertyMap* child = new QQmlPropertyMap(parent);
+    fillPropertyMap(child, value.toObject());
+    return QVariant::fromValue<QObject*>(child);
+}
+
+static void updatePropertyMap(QQmlPropertyMap* map, const QJsonObject& from, const QJsonObject& to, const QString& prefix, QStringList& changed)
+{
+    foreach (const QString& key, from.keys()) {
+        if (!to.contains(key)) {
+            if (QObject* old = map->value(key).value<QObject*>())
+                old->deleteLater();
+            map->clear(key);
+            changed << prefix + key;
+        }
+    }
+
+    for (QJsonObject::const_iterator it = to.constBegin(); it != to.constEnd(); ++it) {
+        QJsonValue previous = from.value(it.key());
+        if (previous == it.value())
+            continue;
+
+        QObject* old = map->value(it.key()).value<QObject*>();
+        QQmlPropertyMap* child = qobject_cast<QQmlPropertyMap*>(old);
+        if (child && previous.isObject() && it.value().isObject()) {
+            // Bindings on the object itself are left alone
+            updatePropertyMap(child, previous.toObject(), it.value().toObject(), prefix + it.key() + QLatin1Char('.'), changed);
+            continue;
+        }
+
+        map->insert(it.key(), toPropertyValue(map, it.value()));
+        // QML may still hold on to it until the bindings are updated
+        if (old)
+            old->deleteLater();
+        changed << prefix + it.key();
+    }
+}
+
 WebOSCompositorConfig::WebOSCompositorConfig()
+    : m_configValid(false)
+    , m_propertyMap(0)
 {
+    m_pool.setMaxThreadCount(1);
+}
 
+WebOSCompositorConfig::~WebOSCompositorConfig()
+{
+    m_pool.waitForDone();
+    delete m_propertyMap;
 }
 
 void WebOSCompositorConfig::load()
 {
+    m_pool.waitForDone();
+    doLoad();
+}
+
+void WebOSCompositorConfig::loadAsync()
+{
+    m_pool.start(new ConfigLoadJob(this));
+}
+
+QStringList WebOSCompositorConfig::reload()
+{
+    m_pool.waitForDone();
+
+    // Both stay valid until the diff is done
+    QScopedPointer<QFile> previousCache(m_cacheFile.take());
+    QJsonObject previous = m_root;
+
+    doLoad();
+
+    QStringList changed;
+    if (m_propertyMap)
+        updatePropertyMap(m_propertyMap, previous, m_root, QString(), changed);
+
+    qInfo() << "Config: reloaded, changed keys:" << changed;
+    return changed;
+}
+
+void WebOSCompositorConfig::doLoad()
+{
+    WebOSStartupPhase phase("configLoad");
+
     // Check if the env spcifies an alternative base path
     QString base = QString::fromLocal8Bit(qgetenv("WEBOS_COMPOSITOR_SETTINGS_BASE"));
     if (base.isEmpty()) {
@@ -47,6 +183,12 @@ void WebOSCompositorConfig::load()
         configFiles << "/var/preferences/com.webos.surfacemanager/devel.json";
     }
 
+    QString cache = cachePath();
+    QJsonArray sources = sourceStamps(configFiles);
+    m_configValid = false;
+    if (!cache.isEmpty() && loadCache(cache, sources))
+        return;
+
     Node root("root");
     foreach (QString path, configFiles) {
         QFile file(path);
@@ -71,12 +213,81 @@ void WebOSCompositorConfig::load()
         }
     }
 
-    root.write(m_root);
+    QJsonObject merged;
+    root.write(merged);
+    m_root = merged.value(QStringLiteral("root")).toObject();
+    m_cacheFile.reset();
+
+    if (!cache.isEmpty())
+        writeCache(cache, sources);
+}
+
+bool WebOSCompositorConfig::loadCache(const QString& path, const QJsonArray& sources)
+{
+    QScopedPointer<QFile> file(new QFile(path));
+    if (!file->open(QIODevice::ReadOnly))
+        return false;
+
+    // Checked on what has been opened, not to be raced by a rename
+    struct stat st;
+    if (fstat(file->handle(), &st) != 0 || st.st_uid != getuid() || (st.st_mode & (S_IWGRP | S_IWOTH))) {
+        qWarning() << "Config: cache" << path << "is not owned by us or is writable by others, ignored";
+        return false;
+    }
+
+    // Mapped pages are aligned as the binary format requires
+    uchar* data = file->map(0, file->size());
+    if (!data)
+        return false;
+
+    QJsonDocument doc = QJsonDocument::fromRawData(reinterpret_cast<const char*>(data), file->size(), QJsonDocument::Validate);
+    if (!doc.isObject() || doc.object().value(QStringLiteral("sources")).toArray() != sources) {
+        qInfo() << "Config: cache" << path << "is out of date";
+        return false;
+    }
+
+    m_root = doc.object().value(QStringLiteral("config")).toObject();
+    m_cacheFile.reset(file.take());
+    return true;
+}
+
+void WebOSCompositorConfig::writeCache(const QString& path, const QJsonArray& sources)
+{
+    QJsonObject cache;
+    cache[QStringLiteral("sources")] = sources;
+    cache[QStringLiteral("config")] = m_root;
+
+    // Replaced atomically, a mapping of the old one stays valid
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Config: cannot write cache" << path << file.errorString();
+        return;
+    }
+    // Whatever the umask, or loadCache() would not take it
+    fchmod(file.handle(), S_IRUSR | S_IWUSR);
+    file.write(QJsonDocument(cache).toBinaryData());
+    if (!file.commit())
+        qWarning() << "Config: cannot write cache" << path << file.errorString();
 }
 
 QVariantMap WebOSCompositorConfig::config()
 {
-    return m_root["root"].toObject().toVariantMap();
+    m_pool.waitForDone();
+    if (!m_configValid) {
+        m_config = m_root.toVariantMap();
+        m_configValid = true;
+    }
+    return m_config;
+}
+
+QQmlPropertyMap* WebOSCompositorConfig::propertyMap()
+{
+    m_pool.waitForDone();
+    if (!m_propertyMap) {
+        m_propertyMap = new QQmlPropertyMap;
+        fillPropertyMap(m_propertyMap, m_root);
+    }
+    return m_propertyMap;
 }
 
 void WebOSCompositorConfig::merge(Node* root, const QJsonObject& from)
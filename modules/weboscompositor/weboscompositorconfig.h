@@ -18,11 +18,17 @@
 #define WEBOSCOMPOSITORCONFIG_H
 
 #include <QFile>
+#include <QJsonArray>
 #include <QJsonObject>
 #include <QJsonParseError>
 #include <QMap>
+#include <QScopedPointer>
+#include <QStringList>
+#include <QThreadPool>
 #include <QVariant>
 
+class QQmlPropertyMap;
+
 // A temporaty class to allow the combination of multiple JSON objects
 // into one so that there are no duplicates. Kinda wonky but there are
 // no stock solutions and this is still pretty straight forward.
@@ -74,18 +80,43 @@ private:
     QMap<QString, Node*> m_children;
 };
 
+// The merged result is cached in the binary JSON format, valid as long as
+// the source files keep their size and mtime. The cache is mapped rather
+// than read, see WEBOS_COMPOSITOR_CONFIG_CACHE. Without it, the cache is
+// kept in XDG_RUNTIME_DIR and not at all when that is not set. A cache not
+// owned by the user or writable by others is ignored.
 class WebOSCompositorConfig {
 
 public:
     WebOSCompositorConfig();
+    ~WebOSCompositorConfig();
 
     void load();
+    // Parses the files on a worker thread, config() waits for it
+    void loadAsync();
+    // Loads again and updates only the keys of propertyMap() that changed,
+    // returns their paths such as "launcher.width"
+    QStringList reload();
 
     QVariantMap config();
+    // The config for QML, one nested map per object
+    QQmlPropertyMap* propertyMap();
 
 private:
+    friend class ConfigLoadJob;
+
+    void doLoad();
     void merge(Node* root, const QJsonObject& from);
+    bool loadCache(const QString& path, const QJsonArray& sources);
+    void writeCache(const QString& path, const QJsonArray& sources);
+
     QJsonObject m_root;
+    QVariantMap m_config;
+    bool m_configValid;
+    // Keeps the cache mapped while m_root refers to it
+    QScopedPointer<QFile> m_cacheFile;
+    QQmlPropertyMap* m_propertyMap;
+    QThreadPool m_pool;
 };
 
 #endif
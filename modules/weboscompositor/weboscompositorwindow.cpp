@@ -15,6 +15,7 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include <QQmlContext>
+#include <QQmlComponent>
 #include <QQuickItem>
 #include <QMetaObject>
 #include <QGuiApplication>
@@ -24,12 +25,18 @@
 
 #include "weboscompositorwindow.h"
 #include "weboscorecompositor.h"
+#include "webossnapshotcache.h"
+#include "webosstartuptracer.h"
 #ifdef USE_CONFIG
 #include "weboscompositorconfig.h"
 #endif
 
-WebOSCompositorWindow::WebOSCompositorWindow(QString geometryString, QSurfaceFormat *surfaceFormat)
+// Time in ms without a frame for the scene to go back to full resolution
+static const int RenderScaleIdleTime = 1000;
+
+WebOSCompositorWindow::WebOSCompositorWindow(QString geometryString, QSurfaceFormat *surfaceFormat, int displayId)
     : QQuickView()
+    , m_displayId(displayId)
     , m_compositor(0)
     , m_baseGeometry(QRect(0, 0, 1920, 1080))
     , m_outputGeometry(QRect())
@@ -41,7 +48,20 @@ WebOSCompositorWindow::WebOSCompositorWindow(QString geometryString, QSurfaceFor
     , m_newOutputRotationPending(-1)
     , m_outputGeometryPending(false)
     , m_outputGeometryPendingInterval(0)
+    , m_outputUpdateLatency(-1)
+    , m_renderScale(1.0)
+    , m_minimumRenderScale(0.75)
+    , m_frameTimeBudget(0)
+    , m_frameTimeAverage(0)
+    , m_frameCount(0)
+    , m_renderScheduling(false)
+    , m_renderCostAverage(0)
+    , m_renderCost(0)
+    , m_deferredUpdates(0)
+    , m_renderedFrames(0)
     , m_cursorVisible(false)
+    , m_mainComponent(0)
+    , m_mainLoading(false)
 {
     if (surfaceFormat) {
         setFormat(*surfaceFormat);
@@ -63,8 +83,25 @@ WebOSCompositorWindow::WebOSCompositorWindow(QString geometryString, QSurfaceFor
     setClearBeforeRendering(true);
     setColor(Qt::transparent);
 
+    if (m_displayId > 0) {
+        QList<QScreen *> screens = QGuiApplication::screens();
+        if (m_displayId < screens.count())
+            setScreen(screens.at(m_displayId));
+        else
+            qWarning() << "OutputGeometry:" << this << "no screen for display" << m_displayId << "sharing the primary one";
+    }
+
+#ifdef USE_CONFIG
+    // Parsed while the platform window is created
+    m_config = new WebOSCompositorConfig;
+    m_config->loadAsync();
+#endif
+
     // We need a platform window right now
-    create();
+    {
+        WebOSStartupPhase phase("windowCreate");
+        create();
+    }
 
     QSize screenSize = screen() ? screen()->size() : QSize();
     qreal dpr = devicePixelRatio();
@@ -80,11 +117,15 @@ WebOSCompositorWindow::WebOSCompositorWindow(QString geometryString, QSurfaceFor
         qWarning() << "OutputGeometry:" << this << "device pixel ratio unset, use default" << dpr;
     }
 
+    QByteArray geometryEnv = m_displayId > 0 ?
+        QByteArray("WEBOS_COMPOSITOR_GEOMETRY_") + QByteArray::number(m_displayId) :
+        QByteArray("WEBOS_COMPOSITOR_GEOMETRY");
+
     if (!geometryString.isEmpty()) {
         qInfo() << "OutputGeometry: using geometryString" << geometryString;
-    } else if (geometryString.isEmpty() && !qEnvironmentVariableIsEmpty("WEBOS_COMPOSITOR_GEOMETRY")) {
-        geometryString = QString(qgetenv("WEBOS_COMPOSITOR_GEOMETRY"));
-        qInfo() << "OutputGeometry: using geometryString from WEBOS_COMPOSITOR_GEOMETRY" << geometryString;
+    } else if (geometryString.isEmpty() && !qEnvironmentVariableIsEmpty(geometryEnv.constData())) {
+        geometryString = QString(qgetenv(geometryEnv.constData()));
+        qInfo() << "OutputGeometry: using geometryString from" << geometryEnv << geometryString;
     } else {
         geometryString = QString("1920x1080+0+0r0s1");
         qWarning() << "OutputGeometry: no geometryString set, using default" << geometryString;
@@ -111,13 +152,31 @@ WebOSCompositorWindow::WebOSCompositorWindow(QString geometryString, QSurfaceFor
     // More info
     qDebug() << "OutputGeometry:" << this << "screen:" << screenSize << dpr;
 
-#ifdef USE_CONFIG
-    m_config = new WebOSCompositorConfig;
-    m_config->load();
-#endif
-
     m_outputGeometryPendingTimer.setSingleShot(true);
     connect(&m_outputGeometryPendingTimer, &QTimer::timeout, this, &WebOSCompositorWindow::onOutputGeometryPendingExpired);
+
+    bool ok = false;
+    qreal budget = qgetenv("WEBOS_COMPOSITOR_FRAME_TIME_BUDGET").toDouble(&ok);
+    if (ok && budget > 0)
+        setFrameTimeBudget(budget);
+    qreal minScale = qgetenv("WEBOS_COMPOSITOR_MIN_RENDER_SCALE").toDouble(&ok);
+    if (ok)
+        setMinimumRenderScale(minScale);
+
+    connect(this, &QQuickWindow::frameSwapped, this, &WebOSCompositorWindow::onFrameSwapped);
+    m_renderScaleTimer.setSingleShot(true);
+    m_renderScaleTimer.setInterval(RenderScaleIdleTime);
+    connect(&m_renderScaleTimer, &QTimer::timeout, this, [this]() { setRenderScale(1.0); });
+
+    m_syncTimer.setSingleShot(true);
+    m_syncTimer.setTimerType(Qt::PreciseTimer);
+    connect(&m_syncTimer, &QTimer::timeout, this, &WebOSCompositorWindow::onSyncTimer);
+    // Measured where rendering happens, whichever thread it is
+    connect(this, &QQuickWindow::beforeSynchronizing, this, &WebOSCompositorWindow::onBeforeSynchronizing, Qt::DirectConnection);
+    connect(this, &QQuickWindow::afterRendering, this, &WebOSCompositorWindow::onAfterRendering, Qt::DirectConnection);
+
+    if (qEnvironmentVariableIntValue("WEBOS_COMPOSITOR_RENDER_SCHEDULING") > 0)
+        setRenderScheduling(true);
 }
 
 WebOSCompositorWindow::~WebOSCompositorWindow()
@@ -161,15 +220,24 @@ void WebOSCompositorWindow::setCompositor(WebOSCoreCompositor* compositor)
         // Should be set after m_compositor is determined
         setBaseGeometry(m_outputGeometry, m_outputRotation, m_outputRatio);
 
+        if (m_displayId > 0)
+            m_compositor->registerWindow(this);
+
         // Set global context properties available to qml everywhere
         rootContext()->setContextProperty(QLatin1String("compositor"), m_compositor);
         rootContext()->setContextProperty(QLatin1String("compositorWindow"), this);
 #ifdef USE_CONFIG
-        rootContext()->setContextProperty(QLatin1String("config"), m_config->config());
+        // Only the changed keys are updated on SIGHUP
+        rootContext()->setContextProperty(QLatin1String("config"), m_config->propertyMap());
+        connect(m_compositor, &WebOSCoreCompositor::reloadConfig, this, [this]() { m_config->reload(); });
 #endif
 
+        // Card snapshots, see WebOSSurfaceItem::cardSnapShotUrl
+        engine()->addImageProvider(QLatin1String("snapshot"), new SnapshotImageProvider(m_compositor->snapshotCache()));
+
+        // Extra displays keep their own main, set by whoever creates them
         QString overridePath = QString::fromUtf8(qgetenv("WEBOS_COMPOSITOR_MAIN"));
-        if (!overridePath.isEmpty()) {
+        if (m_displayId == 0 && !overridePath.isEmpty()) {
             setCompositorMain(QUrl::fromLocalFile(overridePath));
         }
     }
@@ -178,7 +246,7 @@ void WebOSCompositorWindow::setCompositor(WebOSCoreCompositor* compositor)
 bool WebOSCompositorWindow::setCompositorMain(const QUrl& main)
 {
     // Allow the source setting only once
-    if (source().isValid()) {
+    if (source().isValid() || m_mainLoading) {
         qCritical() << this << "Trying to override current source";
         return false;
     }
@@ -186,10 +254,67 @@ bool WebOSCompositorWindow::setCompositorMain(const QUrl& main)
     if (!m_compositor)
         qWarning() << this << "No compositor assigned, assuming that it is loaded from QML";
 
-    setSource(main);
+    if (m_mainComponent && m_mainComponent->url() == main && m_mainComponent->isLoading()) {
+        // Created once compiled, clients are accepted in the meantime
+        qInfo() << this << "Compositor main still compiling, deferring its creation";
+        m_mainLoading = true;
+        WebOSStartupTracer::begin("qmlLoad");
+        connect(m_mainComponent, &QQmlComponent::statusChanged, this, &WebOSCompositorWindow::onMainComponentStatusChanged);
+        return true;
+    }
+
+    {
+        WebOSStartupPhase phase("qmlLoad");
+        // Waits for the compilation if started by compileCompositorMain
+        setSource(main);
+    }
+
+    // The view holds on to the compiled type from now on
+    delete m_mainComponent;
+    m_mainComponent = 0;
+
+    if (m_displayId == 0 && m_compositor)
+        m_compositor->setViewsReady(true);
     return true;
 }
 
+void WebOSCompositorWindow::onMainComponentStatusChanged(QQmlComponent::Status status)
+{
+    if (status == QQmlComponent::Loading)
+        return;
+
+    WebOSStartupTracer::end("qmlLoad");
+    m_mainLoading = false;
+
+    if (status == QQmlComponent::Error) {
+        qCritical() << this << "Failed to load" << m_mainComponent->url() << m_mainComponent->errors();
+    } else {
+        WebOSStartupPhase phase("qmlCreate");
+        // As setSource() does, with the component compiled already. The
+        // view takes the component over.
+        QObject *root = m_mainComponent->beginCreate(rootContext());
+        setContent(m_mainComponent->url(), m_mainComponent, root);
+        m_mainComponent->completeCreate();
+        if (!root)
+            qCritical() << this << "Failed to create" << m_mainComponent->url() << m_mainComponent->errors();
+        m_mainComponent = 0;
+    }
+
+    if (m_displayId == 0 && m_compositor)
+        m_compositor->setViewsReady(true);
+}
+
+void WebOSCompositorWindow::compileCompositorMain(const QUrl& main)
+{
+    if (m_mainComponent || source().isValid())
+        return;
+
+    // Same as what setCompositor() ends up loading
+    QString overridePath = m_displayId == 0 ? QString::fromUtf8(qgetenv("WEBOS_COMPOSITOR_MAIN")) : QString();
+    QUrl url = overridePath.isEmpty() ? main : QUrl::fromLocalFile(overridePath);
+    m_mainComponent = new QQmlComponent(engine(), url, QQmlComponent::Asynchronous, this);
+}
+
 void WebOSCompositorWindow::showWindow()
 {
     qDebug() << this << "Showing compositor window";
@@ -255,10 +380,13 @@ void WebOSCompositorWindow::updateOutputGeometry(const int rotation, bool forced
 
     if (forced || m_outputGeometry != newGeometry || rotation != m_outputRotation) {
         setNewOutputGeometry(newGeometry, rotation);
+        m_outputUpdateTime.start();
 
+        // Clients see one output which follows the primary display,
+        // extra displays only rotate their own view.
         bool pending = false;
-        if (m_outputGeometryPendingInterval != 0 && m_outputRotation % 180 != m_newOutputRotation % 180) {
-            if (m_compositor->prepareOutputUpdate() > 0)
+        if (m_displayId == 0 && m_outputGeometryPendingInterval != 0 && m_outputRotation % 180 != m_newOutputRotation % 180) {
+            if (m_compositor->prepareOutputUpdate(m_outputGeometryPendingInterval) > 0)
                 pending = true;
         }
 
@@ -287,7 +415,8 @@ void WebOSCompositorWindow::sendOutputGeometry() const
         return;
     }
 
-    m_compositor->commitOutputUpdate(m_newOutputGeometry, m_newOutputRotation, m_outputRatio);
+    if (m_displayId == 0)
+        m_compositor->commitOutputUpdate(m_newOutputGeometry, m_newOutputRotation, m_outputRatio);
 }
 
 void WebOSCompositorWindow::applyOutputGeometry()
@@ -301,7 +430,8 @@ void WebOSCompositorWindow::applyOutputGeometry()
         << "rotation:" << m_outputRotation << "->" << m_newOutputRotation;
 
     disconnect(m_compositor, &WebOSCoreCompositor::outputUpdateDone, this, &WebOSCompositorWindow::onOutputGeometryDone);
-    m_compositor->finalizeOutputUpdate();
+    if (m_displayId == 0)
+        m_compositor->finalizeOutputUpdate();
 
     if (m_outputGeometry != m_newOutputGeometry) {
         m_outputGeometry = m_newOutputGeometry;
@@ -313,6 +443,13 @@ void WebOSCompositorWindow::applyOutputGeometry()
         emit outputRotationChanged();
     }
 
+    if (m_outputUpdateTime.isValid()) {
+        m_outputUpdateLatency = m_outputUpdateTime.elapsed();
+        m_outputUpdateTime.invalidate();
+        qInfo() << "OutputGeometry:" << this << "output update took" << m_outputUpdateLatency << "ms";
+        emit outputUpdateLatencyChanged();
+    }
+
     if (m_newOutputRotationPending != -1) {
         updateOutputGeometry(m_newOutputRotationPending, false);
         m_newOutputRotationPending = -1;
@@ -321,10 +458,9 @@ void WebOSCompositorWindow::applyOutputGeometry()
 
 void WebOSCompositorWindow::onOutputGeometryDone()
 {
-    // As some clients may need more time to update their surfaces,
-    // use the timer to defer calling setOutputGeometryPending.
+    // Every client has either acked or missed its deadline, no need to wait any longer
     qDebug() << "OutputGeometry:" << this << "all watched items have been resized";
-    m_outputGeometryPendingTimer.start(200);
+    setOutputGeometryPending(false);
 }
 
 bool WebOSCompositorWindow::outputGeometryPending() const
@@ -341,11 +477,13 @@ void WebOSCompositorWindow::setOutputGeometryPending(bool pending)
     emit outputGeometryPendingChanged();
 
     if (m_outputGeometryPending) {
+        // Only a fallback, the clients may be given longer than the interval
+        int timeout = qMax(m_outputGeometryPendingInterval, m_compositor->outputUpdateTimeout());
         qInfo() << "OutputGeometry:" << this
             << "pending update:" << m_outputGeometry << "->" << m_newOutputGeometry
             << "rotation:" << m_outputRotation << "->" << m_newOutputRotation
-            << "timeout:" << m_outputGeometryPendingInterval;
-        m_outputGeometryPendingTimer.start(m_outputGeometryPendingInterval);
+            << "timeout:" << timeout;
+        m_outputGeometryPendingTimer.start(timeout);
     } else {
         m_outputGeometryPendingTimer.stop();
         applyOutputGeometry();
@@ -369,6 +507,176 @@ void WebOSCompositorWindow::onOutputGeometryPendingExpired()
     setOutputGeometryPending(false);
 }
 
+void WebOSCompositorWindow::setMinimumRenderScale(qreal scale)
+{
+    scale = qBound(0.25, scale, 1.0);
+    if (!qFuzzyCompare(m_minimumRenderScale, scale)) {
+        m_minimumRenderScale = scale;
+        emit minimumRenderScaleChanged();
+    }
+}
+
+void WebOSCompositorWindow::setFrameTimeBudget(qreal budget)
+{
+    if (budget < 0)
+        budget = 0;
+
+    if (!qFuzzyCompare(m_frameTimeBudget + 1, budget + 1)) {
+        qInfo() << "RenderScale:" << this << "frameTimeBudget:" << m_frameTimeBudget << "->" << budget;
+        m_frameTimeBudget = budget;
+        emit frameTimeBudgetChanged();
+
+        if (m_frameTimeBudget == 0)
+            setRenderScale(1.0);
+    }
+}
+
+void WebOSCompositorWindow::setRenderScale(qreal scale)
+{
+    m_frameCount = 0;
+    m_frameTimeAverage = 0;
+    m_renderScaleTimer.stop();
+
+    if (!qFuzzyCompare(m_renderScale, scale)) {
+        qInfo() << "RenderScale:" << this << m_renderScale << "->" << scale;
+        m_renderScale = scale;
+        emit renderScaleChanged();
+    }
+}
+
+void WebOSCompositorWindow::onFrameSwapped()
+{
+    // Frames further apart than this are not part of an animation
+    static const qreal FrameGap = 100;
+    // Number of frames to average before deciding anything
+    static const int FrameWindow = 8;
+
+    m_lastSwap.start();
+    m_renderedFrames++;
+
+    if (m_frameTimeBudget <= 0)
+        return;
+
+    if (!m_frameTime.isValid()) {
+        m_frameTime.start();
+        return;
+    }
+
+    qreal frameTime = m_frameTime.nsecsElapsed() / 1000000.0;
+    m_frameTime.restart();
+
+    // Full resolution again only once the scene has been idle for a while
+    if (m_renderScale < 1.0)
+        m_renderScaleTimer.start();
+
+    if (frameTime > FrameGap) {
+        // Not part of the same animation, start averaging over
+        m_frameCount = 0;
+        return;
+    }
+
+    m_frameTimeAverage = m_frameCount > 0 ? (m_frameTimeAverage * 7 + frameTime) / 8 : frameTime;
+    if (++m_frameCount < FrameWindow)
+        return;
+
+    // Once reduced, stay so until the scene is idle to avoid flipping back and forth
+    if (m_renderScale == 1.0 && m_frameTimeAverage > m_frameTimeBudget) {
+        qInfo() << "RenderScale:" << this << "average frame time" << m_frameTimeAverage << "ms over budget" << m_frameTimeBudget;
+        setRenderScale(m_minimumRenderScale);
+    }
+}
+
+void WebOSCompositorWindow::setRenderScheduling(bool enabled)
+{
+    if (m_renderScheduling != enabled) {
+        qInfo() << "RenderScheduler:" << this << "enabled:" << m_renderScheduling << "->" << enabled;
+        m_renderScheduling = enabled;
+        emit renderSchedulingChanged();
+
+        // Do not leave a held back update behind
+        if (!m_renderScheduling && m_syncTimer.isActive()) {
+            m_syncTimer.stop();
+            onSyncTimer();
+        }
+    }
+}
+
+QVariantMap WebOSCompositorWindow::renderSchedulerInfo() const
+{
+    QVariantMap info;
+    info.insert(QStringLiteral("enabled"), m_renderScheduling);
+    info.insert(QStringLiteral("frameInterval"), frameInterval());
+    info.insert(QStringLiteral("renderCost"), renderCost());
+    info.insert(QStringLiteral("renderedFrames"), m_renderedFrames);
+    info.insert(QStringLiteral("deferredUpdates"), m_deferredUpdates);
+    return info;
+}
+
+qreal WebOSCompositorWindow::frameInterval() const
+{
+    qreal rate = screen() ? screen()->refreshRate() : 0;
+    return rate > 0 ? 1000.0 / rate : 1000.0 / 60;
+}
+
+qint64 WebOSCompositorWindow::syncDelay() const
+{
+    // Margin for the sync itself and the timer latency
+    static const qreal SyncMargin = 2.0;
+
+    if (!m_lastSwap.isValid())
+        return 0;
+
+    // If a vsync has passed since the last swap, the scene has been idle
+    // and nothing tells when the next one comes. Render right away.
+    qreal sinceSwap = m_lastSwap.nsecsElapsed() / 1000000.0;
+    qreal interval = frameInterval();
+    if (sinceSwap >= interval)
+        return 0;
+
+    qreal syncAt = interval - renderCost() - SyncMargin;
+    return syncAt > sinceSwap ? (qint64) (syncAt - sinceSwap) : 0;
+}
+
+bool WebOSCompositorWindow::event(QEvent *event)
+{
+    if (event->type() == QEvent::UpdateRequest && m_renderScheduling) {
+        if (m_syncTimer.isActive())
+            return true;
+
+        qint64 delay = syncDelay();
+        if (delay > 0) {
+            m_deferredUpdates++;
+            m_syncTimer.start(delay);
+            return true;
+        }
+    }
+
+    return QQuickView::event(event);
+}
+
+void WebOSCompositorWindow::onSyncTimer()
+{
+    QEvent updateRequest(QEvent::UpdateRequest);
+    QQuickView::event(&updateRequest);
+}
+
+void WebOSCompositorWindow::onBeforeSynchronizing()
+{
+    m_syncTime.start();
+}
+
+void WebOSCompositorWindow::onAfterRendering()
+{
+    if (!m_syncTime.isValid())
+        return;
+
+    // Average of the CPU side cost from sync to the end of rendering
+    qreal cost = m_syncTime.nsecsElapsed() / 1000000.0;
+    m_renderCostAverage = m_renderCostAverage > 0 ? (m_renderCostAverage * 7 + cost) / 8 : cost;
+    m_renderCost.storeRelease(qRound(m_renderCostAverage * 1000));
+    m_syncTime.invalidate();
+}
+
 void WebOSCompositorWindow::setDefaultCursor()
 {
     /* Qt::ArrowCursor means system default cursor */
@@ -20,9 +20,13 @@
 #include <WebOSCoreCompositor/weboscompositorexport.h>
 
 #include <QQuickView>
+#include <QQmlComponent>
 #include <QUrl>
 #include <QTimer>
+#include <QElapsedTimer>
+#include <QAtomicInt>
 #include <QRunnable>
+#include <QVariantMap>
 
 class WebOSCoreCompositor;
 #ifdef USE_CONFIG
@@ -33,24 +37,52 @@ class WEBOS_COMPOSITOR_EXPORT WebOSCompositorWindow : public QQuickView {
 
     Q_OBJECT
 
+    Q_PROPERTY(int displayId READ displayId CONSTANT)
     Q_PROPERTY(QRect outputGeometry READ outputGeometry NOTIFY outputGeometryChanged)
     Q_PROPERTY(int outputRotation READ outputRotation NOTIFY outputRotationChanged)
     Q_PROPERTY(bool outputClip READ outputClip NOTIFY outputClipChanged)
     Q_PROPERTY(bool outputGeometryPending READ outputGeometryPending WRITE setOutputGeometryPending NOTIFY outputGeometryPendingChanged)
     Q_PROPERTY(int outputGeometryPendingInterval READ outputGeometryPendingInterval WRITE setOutputGeometryPendingInterval NOTIFY outputGeometryPendingIntervalChanged)
+    Q_PROPERTY(int outputUpdateLatency READ outputUpdateLatency NOTIFY outputUpdateLatencyChanged)
+    Q_PROPERTY(qreal renderScale READ renderScale NOTIFY renderScaleChanged)
+    Q_PROPERTY(qreal minimumRenderScale READ minimumRenderScale WRITE setMinimumRenderScale NOTIFY minimumRenderScaleChanged)
+    Q_PROPERTY(qreal frameTimeBudget READ frameTimeBudget WRITE setFrameTimeBudget NOTIFY frameTimeBudgetChanged)
+    Q_PROPERTY(bool renderScheduling READ renderScheduling WRITE setRenderScheduling NOTIFY renderSchedulingChanged)
     Q_PROPERTY(bool cursorVisible READ cursorVisible NOTIFY cursorVisibleChanged)
 
 public:
-    WebOSCompositorWindow(QString geometryString = QString(), QSurfaceFormat *surfaceFormat = 0);
+    /*!
+     * Creates the compositor window for the display \a displayId.
+     * Display 0 is the primary one which drives the output advertised to
+     * clients. Extra displays read their geometry string from
+     * WEBOS_COMPOSITOR_GEOMETRY_<displayId> and are put on the screen with
+     * the same index if there is one.
+     */
+    WebOSCompositorWindow(QString geometryString = QString(), QSurfaceFormat *surfaceFormat = 0, int displayId = 0);
     ~WebOSCompositorWindow();
 
     static bool parseGeometryString(QString string, QRect &geometry, int &rotation, double &ratio);
 
     void setCompositor(WebOSCoreCompositor* compositor);
+    /*!
+     * Loads \a main as the content of the window. If it is still being
+     * compiled since compileCompositorMain(), this returns right away and
+     * the content is created once the compilation is done, so that the
+     * event loop can start serving clients meanwhile. Surfaces mapped
+     * until then are delivered to the views afterwards.
+     */
     bool setCompositorMain(const QUrl& main);
+    /*!
+     * Starts compiling \a main and what it imports on the loader thread of
+     * the QML engine, so that setCompositorMain() only has to wait for the
+     * rest. The types used by \a main must have been registered already.
+     */
+    void compileCompositorMain(const QUrl& main);
 
     Q_INVOKABLE void showWindow();
 
+    int displayId() const { return m_displayId; }
+
     QRect outputGeometry() const;
     int outputRotation() const;
     bool outputClip() const;
@@ -63,6 +95,36 @@ public:
     int outputGeometryPendingInterval() const;
     void setOutputGeometryPendingInterval(int);
 
+    /*!
+     * Time in ms the last output update took from the request until the
+     * new geometry was applied, or -1 if there has been none.
+     */
+    int outputUpdateLatency() const { return m_outputUpdateLatency; }
+
+    /*!
+     * Scale the scene should be rendered at, 1.0 for the full resolution.
+     * It drops to minimumRenderScale when frames take longer than
+     * frameTimeBudget (ms) and goes back to 1.0 once no frame has been
+     * rendered for a second, so that animations in a row are all rendered
+     * at the reduced scale rather than switching for each.
+     * A frameTimeBudget of 0 disables dynamic resolution.
+     */
+    qreal renderScale() const { return m_renderScale; }
+    qreal minimumRenderScale() const { return m_minimumRenderScale; }
+    void setMinimumRenderScale(qreal scale);
+    qreal frameTimeBudget() const { return m_frameTimeBudget; }
+    void setFrameTimeBudget(qreal budget);
+
+    /*!
+     * With render scheduling an update request is held back so that the
+     * scene is synchronized as late as possible before the next vsync, as
+     * predicted from the last swap, the refresh rate and the measured render
+     * cost. Client commits arriving meanwhile make it into the same frame.
+     */
+    bool renderScheduling() const { return m_renderScheduling; }
+    void setRenderScheduling(bool enabled);
+    Q_INVOKABLE QVariantMap renderSchedulerInfo() const;
+
     void setDefaultCursor();
     void invalidateCursor();
 
@@ -76,10 +138,16 @@ signals:
     void outputClipChanged();
     void outputGeometryPendingChanged();
     void outputGeometryPendingIntervalChanged();
+    void outputUpdateLatencyChanged();
+    void renderScaleChanged();
+    void minimumRenderScaleChanged();
+    void frameTimeBudgetChanged();
+    void renderSchedulingChanged();
 
     void cursorVisibleChanged();
 
 private:
+    int m_displayId;
     WebOSCoreCompositor* m_compositor;
 #ifdef USE_CONFIG
     WebOSCompositorConfig* m_config;
@@ -99,17 +167,55 @@ private:
     QTimer m_outputGeometryPendingTimer;
     int m_outputGeometryPendingInterval;
 
+    QElapsedTimer m_outputUpdateTime;
+    int m_outputUpdateLatency;
+
+    qreal m_renderScale;
+    qreal m_minimumRenderScale;
+    qreal m_frameTimeBudget;
+    QElapsedTimer m_frameTime;
+    qreal m_frameTimeAverage;
+    int m_frameCount;
+    QTimer m_renderScaleTimer;
+
+    void setRenderScale(qreal scale);
+
+    bool m_renderScheduling;
+    QTimer m_syncTimer;
+    QElapsedTimer m_lastSwap;
+    // Sampled where rendering happens, on the render thread with the
+    // threaded render loop. Only the average in us is read elsewhere.
+    QElapsedTimer m_syncTime;
+    qreal m_renderCostAverage;
+    QAtomicInt m_renderCost;
+    int m_deferredUpdates;
+    int m_renderedFrames;
+
+    qreal frameInterval() const;
+    qreal renderCost() const { return m_renderCost.loadAcquire() / 1000.0; }
+    qint64 syncDelay() const;
+
+protected:
+    bool event(QEvent *event) Q_DECL_OVERRIDE;
+
+private:
     bool m_cursorVisible;
 
+    QQmlComponent *m_mainComponent;
+    bool m_mainLoading;
+
     void setNewOutputGeometry(QRect& outputGeometry, int outputRotation);
-    void sendOutputGeometry() const;
+    Q_INVOKABLE void sendOutputGeometry() const;
     void applyOutputGeometry();
 
+    // Runs on the render thread with the threaded render loop, where no
+    // wayland event may be sent. The window lives on the GUI thread so
+    // the call is queued there in that case and made directly otherwise.
     class RotationJob : public QRunnable
     {
     public:
         RotationJob(WebOSCompositorWindow* window) { m_window = window; }
-        void run() Q_DECL_OVERRIDE { m_window->sendOutputGeometry(); }
+        void run() Q_DECL_OVERRIDE { QMetaObject::invokeMethod(m_window, "sendOutputGeometry", Qt::AutoConnection); }
     private:
         WebOSCompositorWindow* m_window;
     };
@@ -119,6 +225,11 @@ private:
 private slots:
     void onOutputGeometryDone();
     void onOutputGeometryPendingExpired();
+    void onFrameSwapped();
+    void onBeforeSynchronizing();
+    void onAfterRendering();
+    void onSyncTimer();
+    void onMainComponentStatusChanged(QQmlComponent::Status status);
 };
 
 #endif // WEBOSCOMPOSITORWINDOW_H
@@ -22,10 +22,21 @@
 
 #include <QDebug>
 #include <QQuickWindow>
+#include <QQuickView>
 #include <QCoreApplication>
 #include <QFileInfo>
 #include <QQmlComponent>
 #include <QProcess>
+#include <QtMath>
+#include <QVector>
+
+#include <limits>
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 #include "weboscorecompositor.h"
 #include "weboscompositorwindow.h"
@@ -45,6 +56,9 @@
 
 #include "webossurfacegroupcompositor.h"
 #include "webosscreenshot.h"
+#include "webosmemorymanager.h"
+#include "webossnapshotcache.h"
+#include "webosstartuptracer.h"
 
 // Needed extra for type registration
 #include "weboskeyfilter.h"
@@ -63,6 +77,18 @@ static QWaylandCompositor::ExtensionFlags compositorFlags = (
                                                         QWaylandCompositor::SurfaceExtension
                                                     );
 
+// Output update deadlines in ms, see prepareOutputUpdate()
+static const qint64 OutputUpdateDefaultTimeout = 1000;
+static const qint64 OutputUpdateMaxDeadline = 5000;
+static const qint64 OutputUpdateDeadlineSlack = 50;
+
+// Resource reclamation defaults in KiB, see deferDelete()
+static const qint64 ReclaimDefaultBudget = 16 * 1024;
+static const qint64 ReclaimDefaultLimit = 64 * 1024;
+// Interval in ms to reclaim at while no frame is rendered, and the least
+// interval between flushes of deferred deletes with nothing queued
+static const int ReclaimIdleInterval = 1000;
+
 #ifdef USE_PMLOGLIB
 #include <PmLogLib.h>
 #endif
@@ -131,6 +157,17 @@ WebOSCoreCompositor::WebOSCoreCompositor(QQuickWindow *window, ExtensionFlags ex
     , m_shell(0)
     , m_acquired(false)
     , m_directRendering(false)
+    , m_lsmReadyPending(false)
+    , m_viewsReady(true)
+    , m_outputUpdateSerial(0)
+    , m_pendingDeletionBytes(0)
+    , m_reclaimedBytes(0)
+    , m_reclaimBudget(ReclaimDefaultBudget * 1024)
+    , m_reclaimLimit(ReclaimDefaultLimit * 1024)
+    , m_flushDeferredDeletes(false)
+    , m_frameReclaimQueued(false)
+    , m_memoryManager(0)
+    , m_snapshotCache(0)
     , m_fullscreenTick(0)
     , m_surfaceGroupCompositor(0)
     , m_unixSignalHandler(new UnixSignalHandler(this))
@@ -148,6 +185,7 @@ WebOSCoreCompositor::WebOSCoreCompositor(QQuickWindow *window, ExtensionFlags ex
 
     setInputMethod(new WebOSInputMethod(this));
 
+    m_windows << window;
     connect(window, SIGNAL(frameSwapped()), this, SLOT(frameSwappedSlot()));
     connect(this, SIGNAL(fullscreenSurfaceChanged()), this, SIGNAL(fullscreenChanged()));
 
@@ -155,11 +193,43 @@ WebOSCoreCompositor::WebOSCoreCompositor(QQuickWindow *window, ExtensionFlags ex
 
     connect(m_unixSignalHandler, &UnixSignalHandler::sighup, this, &WebOSCoreCompositor::reloadConfig);
 
+    m_outputUpdateDeadlineTimer.setSingleShot(true);
+    connect(&m_outputUpdateDeadlineTimer, &QTimer::timeout, this, &WebOSCoreCompositor::onOutputUpdateDeadline);
+
+    bool ok = false;
+    qint64 kbytes = qgetenv("WEBOS_COMPOSITOR_RECLAIM_BUDGET").toLongLong(&ok);
+    if (ok)
+        m_reclaimBudget = kbytes > 0 ? kbytes * 1024 : -1;
+    kbytes = qgetenv("WEBOS_COMPOSITOR_RECLAIM_LIMIT").toLongLong(&ok);
+    if (ok && kbytes > 0)
+        m_reclaimLimit = kbytes * 1024;
+
+    // Armed only while there is something queued
+    m_reclaimTimer.setSingleShot(true);
+    m_reclaimTimer.setInterval(ReclaimIdleInterval);
+    connect(&m_reclaimTimer, &QTimer::timeout, this, &WebOSCoreCompositor::onReclaimTimer);
+
+    m_memoryManager = new WebOSMemoryManager(this);
+    m_snapshotCache = new WebOSSnapshotCache(this);
+
     connect(defaultInputDevice()->handle()->keyboardDevice(), &QtWayland::Keyboard::focusChanged, this, &WebOSCoreCompositor::activeSurfaceChanged);
 
     QCoreApplication::instance()->installEventFilter(m_eventPreprocessor);
 
-    m_extensions = CompositorExtensionFactory::create(this);
+    // Extensions not needed at startup follow the first frame, one per
+    // event loop iteration
+    m_deferredExtensionTimer.setSingleShot(true);
+    m_deferredExtensionTimer.setInterval(0);
+    connect(&m_deferredExtensionTimer, &QTimer::timeout, this, &WebOSCoreCompositor::onDeferredExtensionTimer);
+    {
+        WebOSStartupPhase phase("extensionCreate");
+        foreach (const QString &key, CompositorExtensionFactory::requested()) {
+            if (CompositorExtensionFactory::isStartupExtension(key))
+                loadExtension(key);
+            else
+                m_deferredExtensions << key;
+        }
+    }
 
     m_shell = new WebOSShell(this);
 
@@ -191,6 +261,8 @@ void WebOSCoreCompositor::registerTypes()
     qmlRegisterType<WebOSInputMethod>("WebOSCoreCompositor", 1, 0, "InputMethod");
     qmlRegisterType<WebOSSurfaceGroup>("WebOSCoreCompositor", 1, 0, "SurfaceItemGroup");
     qmlRegisterType<WebOSScreenShot>("WebOSCoreCompositor", 1, 0, "ScreenShot");
+    qmlRegisterUncreatableType<WebOSSnapshotCache>("WebOSCoreCompositor", 1, 0, "SnapshotCache", QLatin1String("Not allowed to create SnapshotCache instance"));
+    qmlRegisterUncreatableType<WebOSMemoryManager>("WebOSCoreCompositor", 1, 0, "MemoryManager", QLatin1String("Not allowed to create MemoryManager instance"));
     qmlRegisterUncreatableType<WebOSKeyPolicy>("WebOSCoreCompositor", 1, 0, "KeyPolicy", QLatin1String("Not allowed to create KeyPolicy instance"));
 }
 
@@ -243,6 +315,10 @@ void WebOSCoreCompositor::onSurfaceMapped() {
     WebOSSurfaceItem* item = qobject_cast<WebOSSurfaceItem*>(surface->surfaceItem());
 
     if (item) {
+        // Mapped with the properties the client has set so far
+        if (item->shellSurface())
+            item->shellSurface()->flushProperties();
+
         if (item->isPartOfGroup()) {
             // The management of surface groups is left solely to the qml
             // for example the state changes etc. This is done to ensure that
@@ -270,7 +346,215 @@ void WebOSCoreCompositor::onSurfaceMapped() {
         }
 
         qDebug() << item << "Items in compositor: " <<  getItems();
-        emit surfaceMapped(item);
+        if (m_viewsReady) {
+            emit surfaceMapped(item);
+        } else {
+            qInfo() << "Views not ready, holding back surfaceMapped for" << item;
+            m_pendingMappedItems << item;
+        }
+    }
+}
+
+void WebOSCoreCompositor::setViewsReady(bool ready)
+{
+    if (m_viewsReady == ready)
+        return;
+
+    m_viewsReady = ready;
+    emit viewsReadyChanged();
+
+    if (!m_viewsReady) {
+        m_surfaceModel->setViewsPending(true);
+        return;
+    }
+
+    // As at mapping, window models add the surface before surfaceMapped
+    QList<QPointer<WebOSSurfaceItem> > pending;
+    pending.swap(m_pendingMappedItems);
+    foreach (const QPointer<WebOSSurfaceItem> &item, pending) {
+        // Left out if unmapped or gone in the meantime
+        if (item && isMapped(item)) {
+            qInfo() << "Delivering surfaceMapped held back for" << item.data();
+            m_surfaceModel->announce(item);
+            emit surfaceMapped(item);
+        }
+    }
+    m_surfaceModel->setViewsPending(false);
+}
+
+/*
+ * Returns the scene rectangle of the item if it is neither rotated nor
+ * sheared on the way to the scene
+ */
+static bool axisAlignedSceneRect(QQuickItem *item, QRectF *rect)
+{
+    QPointF topLeft = item->mapToScene(QPointF(0, 0));
+    QPointF topRight = item->mapToScene(QPointF(item->width(), 0));
+    QPointF bottomLeft = item->mapToScene(QPointF(0, item->height()));
+    if (qAbs(topLeft.y() - topRight.y()) > 0.01 || qAbs(topLeft.x() - bottomLeft.x()) > 0.01)
+        return false;
+
+    *rect = QRectF(topLeft, item->mapToScene(QPointF(item->width(), item->height()))).normalized();
+    return true;
+}
+
+static qreal effectiveOpacity(QQuickItem *item)
+{
+    qreal opacity = 1.0;
+    for (; item && opacity > 0; item = item->parentItem())
+        opacity *= item->opacity();
+    return opacity;
+}
+
+// Not 1.0, as the shell uses 0.999 to have items blended
+static const qreal OccluderOpacity = 0.99;
+
+// The item and its ancestors, the root first
+static QVector<QQuickItem*> ancestry(QQuickItem *item)
+{
+    QVector<QQuickItem*> path;
+    for (QQuickItem *i = item; i; i = i->parentItem())
+        path.prepend(i);
+    return path;
+}
+
+/*
+ * Whether the item of \a pathA is painted after the one of \a pathB, by z
+ * and then by order among the children of their closest common ancestor
+ */
+static bool stackedAbove(const QVector<QQuickItem*> &pathA, const QVector<QQuickItem*> &pathB)
+{
+    int common = 0;
+    while (common < pathA.count() && common < pathB.count() && pathA[common] == pathB[common])
+        common++;
+
+    if (common == 0 || common == pathA.count())
+        return false; // Not in the same scene, or A is an ancestor of B
+    if (common == pathB.count())
+        return true;
+
+    QQuickItem *childA = pathA[common];
+    QQuickItem *childB = pathB[common];
+    if (childA->z() != childB->z())
+        return childA->z() > childB->z();
+    QList<QQuickItem*> siblings = pathA[common - 1]->childItems();
+    return siblings.indexOf(childA) > siblings.indexOf(childB);
+}
+
+// The pixels fully within the rectangle, as an occluder must cover them
+static QRect innerRect(const QRectF &rect)
+{
+    return QRect(QPoint(qCeil(rect.left()), qCeil(rect.top())),
+                 QPoint(qFloor(rect.right()) - 1, qFloor(rect.bottom()) - 1));
+}
+
+/*
+ * What an occluder covers in the scene and where it is stacked, looked up
+ * once per frame rather than for every item it may hide
+ */
+struct Occluder
+{
+    WebOSSurfaceItem *item;
+    QRect rect;
+    QVector<QQuickItem*> path;
+};
+
+static QVector<Occluder> occluderGeometry(const QList<WebOSSurfaceItem*> &items)
+{
+    QVector<Occluder> occluders;
+    occluders.reserve(items.count());
+    foreach (WebOSSurfaceItem *item, items) {
+        QRectF rect;
+        if (!axisAlignedSceneRect(item, &rect))
+            continue;
+        Occluder occluder;
+        occluder.item = item;
+        occluder.rect = innerRect(rect);
+        if (occluder.rect.isEmpty())
+            continue;
+        occluder.path = ancestry(item);
+        occluders << occluder;
+    }
+    return occluders;
+}
+
+static QRegion visibleRegion(WebOSSurfaceItem *item, const QVector<Occluder> &occluders)
+{
+    QSize size = item->surface() ? item->surface()->size() : QSize();
+    if (size.isEmpty() || item->width() <= 0 || item->height() <= 0)
+        return QRegion();
+
+    QRect surfaceRect(QPoint(0, 0), size);
+    QQuickWindow *window = item->window();
+    QRectF rect;
+    // Not worth it for transformed items, which are usually animated
+    if (!window || !axisAlignedSceneRect(item, &rect))
+        return surfaceRect;
+
+    QRectF clip(0, 0, window->width(), window->height());
+    for (QQuickItem *parent = item->parentItem(); parent; parent = parent->parentItem()) {
+        QRectF parentRect;
+        if (parent->clip() && axisAlignedSceneRect(parent, &parentRect))
+            clip &= parentRect;
+    }
+
+    QRegion visible(rect.intersected(clip).toAlignedRect());
+    QVector<QQuickItem*> path;
+    foreach (const Occluder &occluder, occluders) {
+        if (occluder.item == item || visible.isEmpty() || !visible.intersects(occluder.rect))
+            continue;
+        // Only looked up if there is an occluder over the item
+        if (path.isEmpty())
+            path = ancestry(item);
+        if (stackedAbove(occluder.path, path))
+            visible -= occluder.rect;
+    }
+
+    // Back to surface coordinates, the surface may be scaled to the item
+    qreal sx = size.width() / item->width();
+    qreal sy = size.height() / item->height();
+    QRegion region;
+    foreach (const QRect &r, visible.rects()) {
+        QRectF local = item->mapRectFromScene(QRectF(r));
+        region += QRectF(local.x() * sx, local.y() * sy, local.width() * sx, local.height() * sy).toAlignedRect();
+    }
+    return region & surfaceRect;
+}
+
+QList<WebOSSurfaceItem*> WebOSCoreCompositor::occluders(QQuickWindow *window) const
+{
+    QList<WebOSSurfaceItem*> items;
+    foreach (WebOSSurfaceItem *item, m_surfaces) {
+        if (item->window() == window && item->opaque() && item->surface()
+                && item->isVisible() && effectiveOpacity(item) >= OccluderOpacity)
+            items << item;
+    }
+    return items;
+}
+
+void WebOSCoreCompositor::updateExposedRegion(WebOSSurfaceItem *item)
+{
+    if (!item->exposed()) {
+        item->setExposedRegion(QRegion(), true);
+        return;
+    }
+    item->setExposedRegion(visibleRegion(item, occluderGeometry(occluders(item->window()))), true);
+}
+
+void WebOSCoreCompositor::updateExposedRegions(QQuickWindow *window)
+{
+    PMTRACE_FUNCTION;
+    QVector<Occluder> windowOccluders;
+    bool occludersKnown = false;
+    foreach (WebOSSurfaceItem *item, m_surfaces) {
+        if (!item->exposed() || item->window() != window)
+            continue;
+        // Only looked up if there is anything exposed on the window
+        if (!occludersKnown) {
+            windowOccluders = occluderGeometry(occluders(window));
+            occludersKnown = true;
+        }
+        item->setExposedRegion(visibleRegion(item, windowOccluders));
     }
 }
 
@@ -293,6 +577,7 @@ void WebOSCoreCompositor::onSurfaceUnmapped() {
 
     if (item) {
         qInfo() << surface << item << item->appId() << item->itemState();
+        m_pendingMappedItems.removeAll(item);
         if (!item->isProxy()) {
             m_surfaceModel->surfaceUnmapped(item);
             emit surfaceUnmapped(item);
@@ -315,8 +600,11 @@ void WebOSCoreCompositor::onSurfaceDestroyed() {
             m_surfaceModel->surfaceDestroyed(item);
             emit surfaceDestroyed(item);
             m_surfaces.removeOne(item);
-            m_surfacesOnUpdate.removeOne(item);
+            removeFromOutputUpdate(item, false);
+            // Has to go right away, see the life cycle comment below.
+            // Its texture is released by the next reclaimResources().
             delete item;
+            m_flushDeferredDeletes = true;
         } else {
             emit surfaceDestroyed(item); //We have to notify qml even for proxy item
             // This means items will not use any graphic resource from related surface.
@@ -335,7 +623,81 @@ void WebOSCoreCompositor::onSurfaceDestroyed() {
 
 void WebOSCoreCompositor::frameSwappedSlot() {
     PMTRACE_FUNCTION;
-    sendFrameCallbacks(surfaces());
+    QQuickWindow *swapped = qobject_cast<QQuickWindow *>(sender());
+
+    if (m_lsmReadyPending && swapped == window()) {
+        QQuickView *view = qobject_cast<QQuickView *>(swapped);
+        if (!view || view->rootObject()) {
+            m_lsmReadyPending = false;
+            emitLsmReady();
+        }
+    }
+
+    // The scene as it has just been shown
+    updateExposedRegions(swapped);
+
+    // Not to compete with the QML still loading
+    if (m_viewsReady && !m_deferredExtensions.isEmpty() && !m_deferredExtensionTimer.isActive())
+        m_deferredExtensionTimer.start();
+
+    if (m_windows.count() < 2) {
+        sendFrameCallbacks(surfaces());
+        scheduleFrameReclaim();
+        return;
+    }
+
+    if (swapped == window())
+        scheduleFrameReclaim();
+
+    // Only the surfaces shown on the window that has just been swapped.
+    // The ones not in any window follow the main window as before.
+    QList<QWaylandSurface *> list;
+    foreach (QWaylandSurface *surface, surfaces()) {
+        QWaylandSurfaceItem *item = static_cast<QWaylandQuickSurface *>(surface)->surfaceItem();
+        QQuickWindow *target = item && item->window() ? item->window() : static_cast<QQuickWindow *>(window());
+        if (target == swapped)
+            list << surface;
+    }
+    sendFrameCallbacks(list);
+}
+
+void WebOSCoreCompositor::registerWindow(QQuickWindow *window)
+{
+    if (!window || m_windows.contains(window))
+        return;
+
+    qInfo() << "Registering window for an extra display" << window << "total:" << m_windows.count() + 1;
+    m_windows << window;
+    connect(window, SIGNAL(frameSwapped()), this, SLOT(frameSwappedSlot()));
+    m_surfaceModel->setDisplayCount(m_windows.count());
+    emit windowCountChanged();
+}
+
+QObject* WebOSCoreCompositor::windowForDisplay(int displayId) const
+{
+    foreach (QQuickWindow *w, m_windows) {
+        if (w->property("displayId").toInt() == displayId)
+            return w;
+    }
+    return 0;
+}
+
+void WebOSCoreCompositor::onSurfaceItemWindowChanged(QQuickWindow *window)
+{
+    WebOSSurfaceItem *item = qobject_cast<WebOSSurfaceItem *>(sender());
+    if (!item || !item->surface() || m_windows.count() < 2)
+        return;
+
+    // Upload the surface texture in the render loop of the window showing it
+    QWaylandQuickSurface *qs = static_cast<QWaylandQuickSurface *>(item->surface());
+    QQuickWindow *target = window ? window : static_cast<QQuickWindow *>(this->window());
+    foreach (QQuickWindow *w, m_windows) {
+        disconnect(w, &QQuickWindow::beforeSynchronizing, qs, &QWaylandQuickSurface::updateTexture);
+        disconnect(w, &QQuickWindow::sceneGraphInvalidated, qs, &QWaylandQuickSurface::invalidateTexture);
+    }
+    connect(target, &QQuickWindow::beforeSynchronizing, qs, &QWaylandQuickSurface::updateTexture, Qt::DirectConnection);
+    connect(target, &QQuickWindow::sceneGraphInvalidated, qs, &QWaylandQuickSurface::invalidateTexture, Qt::DirectConnection);
+    qDebug() << item << "moved to window" << target;
 }
 
 /* Basic life cycle of surface and surface item.
@@ -369,7 +731,14 @@ void WebOSCoreCompositor::surfaceCreated(QWaylandSurface *surface) {
     // ensure that the item will not resize by default. QtWayland is missing a inline
     // initializer for the member variable in the contructor
     item->setResizeSurfaceToItem(false);
-    qInfo() << surface << item << "client pid:" << item->processId();
+    connect(item, &QQuickItem::windowChanged, this, &WebOSCoreCompositor::onSurfaceItemWindowChanged);
+    qInfo() << surface << item << "client pid:" << item->pid();
+}
+
+static qint64 itemTextureBytes(WebOSSurfaceItem *item)
+{
+    QSize size = item->surface() ? item->surface()->size() : QSize(item->width(), item->height());
+    return qint64(size.width()) * size.height() * 4;
 }
 
 WebOSSurfaceItem* WebOSCoreCompositor::createProxyItem(const QString& appId, const QString& title, const QString& subtitle, const QString& snapshotPath)
@@ -379,6 +748,8 @@ WebOSSurfaceItem* WebOSCoreCompositor::createProxyItem(const QString& appId, con
     item->setTitle(title);
     item->setSubtitle(subtitle);
     item->setCardSnapShotFilePath(snapshotPath);
+    // Decoded ahead of the recents showing it
+    m_snapshotCache->prefetch(snapshotPath);
 
     item->setItemState(WebOSSurfaceItem::ItemStateProxy);
     /* To be in recent model */
@@ -404,7 +775,7 @@ void WebOSCoreCompositor::deleteProxyFor(WebOSSurfaceItem* newItem)
             si.remove();
             m_surfaceModel->surfaceDestroyed(item);
             emit surfaceDestroyed(item);
-            delete item;
+            deferDelete(item, itemTextureBytes(item));
         }
     }
 }
@@ -472,7 +843,7 @@ void WebOSCoreCompositor::closeWindow(QVariant window)
     } else {
         m_surfaceModel->surfaceDestroyed(item);
         m_surfaces.removeOne(item);
-        delete item;
+        deferDelete(item, itemTextureBytes(item));
     }
 }
 
@@ -571,6 +942,7 @@ void WebOSCoreCompositor::setKeyFilter(WebOSKeyFilter *filter)
         window()->removeEventFilter(m_keyFilter);
         window()->installEventFilter(filter);
 
+        // Deferred extensions get the filter when they are loaded
         foreach (CompositorExtension* ext, m_extensions) {
             ext->removeEventFilter(m_keyFilter);
             ext->installEventFilter(filter);
@@ -662,12 +1034,66 @@ QWaylandInputDevice *WebOSCoreCompositor::queryInputDevice(QInputEvent *inputEve
 }
 #endif
 
+// Same protocol as sd_notify(), without depending on libsystemd
+static bool notifyServiceManager(const char *state)
+{
+    QByteArray path = qgetenv("NOTIFY_SOCKET");
+    if (path.isEmpty())
+        return false;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= (int) sizeof(addr.sun_path)) {
+        qWarning() << "Ready: NOTIFY_SOCKET too long" << path;
+        return false;
+    }
+    memcpy(addr.sun_path, path.constData(), path.size());
+    // Abstract namespace
+    if (addr.sun_path[0] == '@')
+        addr.sun_path[0] = '\0';
+
+    int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        qWarning() << "Ready: failed to create socket" << strerror(errno);
+        return false;
+    }
+
+    socklen_t length = offsetof(struct sockaddr_un, sun_path) + path.size();
+    ssize_t sent = sendto(fd, state, strlen(state), MSG_NOSIGNAL, (struct sockaddr *) &addr, length);
+    if (sent < 0)
+        qWarning() << "Ready: failed to notify" << path << strerror(errno);
+    close(fd);
+    return sent >= 0;
+}
+
 void WebOSCoreCompositor::emitLsmReady()
 {
     PMTRACE_FUNCTION;
+    WebOSStartupTracer::mark("lsmReady");
+
+    if (notifyServiceManager("READY=1\nSTATUS=First frame shown")) {
+        qInfo() << "Ready: notified" << qgetenv("NOTIFY_SOCKET");
+        return;
+    }
+
+#ifdef UPSTART_SIGNALING
     QString upstartCmd = QLatin1String("/sbin/initctl emit --no-wait lsm-ready");
     qDebug("emit upstart '%s'", qPrintable(upstartCmd));
     QProcess::startDetached(upstartCmd);
+#endif
+}
+
+void WebOSCoreCompositor::emitLsmReadyOnFirstFrame()
+{
+    m_lsmReadyPending = true;
+    // In case a frame is not to come soon
+    static_cast<QQuickWindow *>(window())->update();
+}
+
+QVariantList WebOSCoreCompositor::startupTimeline() const
+{
+    return WebOSStartupTracer::timeline();
 }
 
 
@@ -686,18 +1112,60 @@ QSizeF WebOSCoreCompositor::output() const
     return outputGeometry().size();
 }
 
-int WebOSCoreCompositor::prepareOutputUpdate()
+int WebOSCoreCompositor::prepareOutputUpdate(int timeout)
 {
+    // Drop whatever is left from the previous transaction
+    finalizeOutputUpdate();
+
+    qint64 minDeadline = timeout > 0 ? timeout : OutputUpdateDefaultTimeout;
+    qint64 maxDeadline = qMax(minDeadline, OutputUpdateMaxDeadline);
+    QHash<WaylandClient*, qint64> ackLatency;
+    int count = 0;
+
+    m_outputUpdateSerial++;
+
     foreach (WebOSSurfaceItem *item, m_surfaces) {
         if (!item->surface() || item->width() == item->height())
             continue;
 
+        WaylandClient *client = item->surface()->client();
+        OutputUpdateClient &participant = m_outputUpdateClients[client];
+        if (participant.items.isEmpty()) {
+            // Clients that acked slowly before are waited for longer, never
+            // less than the timeout as one may be slower this time
+            participant.deadline = minDeadline;
+            if (m_outputUpdateAckLatency.contains(client)) {
+                qint64 last = m_outputUpdateAckLatency.value(client);
+                participant.deadline = qBound(minDeadline, 2 * last + OutputUpdateDeadlineSlack, maxDeadline);
+                ackLatency.insert(client, last);
+            }
+        }
+
         connect(item->surface(), &QWaylandSurface::sizeChanged, this, &WebOSCoreCompositor::onSurfaceSizeChanged);
-        m_surfacesOnUpdate << item;
-        qDebug() << "OutputGeometry: watching item for the size change -" << item;
+        participant.items << item;
+        count++;
+        qDebug() << "OutputGeometry: watching item for the size change -" << item << "deadline:" << participant.deadline;
+    }
+
+    // Forget about the clients that are gone
+    m_outputUpdateAckLatency = ackLatency;
+
+    if (count > 0) {
+        qInfo() << "OutputGeometry: output update" << m_outputUpdateSerial << "waits for"
+            << m_outputUpdateClients.count() << "clients," << count << "items";
+        m_outputUpdateTime.start();
+        checkOutputUpdateDone();
     }
 
-    return m_surfacesOnUpdate.count();
+    return count;
+}
+
+int WebOSCoreCompositor::outputUpdateTimeout() const
+{
+    qint64 last = 0;
+    foreach (const OutputUpdateClient &participant, m_outputUpdateClients)
+        last = qMax(last, participant.deadline);
+    return m_outputUpdateClients.isEmpty() ? 0 : qMax<qint64>(0, last - m_outputUpdateTime.elapsed());
 }
 
 void WebOSCoreCompositor::commitOutputUpdate(QRect geometry, int rotation, double ratio)
@@ -718,11 +1186,16 @@ void WebOSCoreCompositor::commitOutputUpdate(QRect geometry, int rotation, doubl
 
 void WebOSCoreCompositor::finalizeOutputUpdate()
 {
-    foreach (WebOSSurfaceItem *item, m_surfacesOnUpdate) {
-        if (item->surface())
-            disconnect(item->surface(), &QWaylandSurface::sizeChanged, this, &WebOSCoreCompositor::onSurfaceSizeChanged);
+    m_outputUpdateDeadlineTimer.stop();
+
+    QHash<WaylandClient*, OutputUpdateClient>::const_iterator it;
+    for (it = m_outputUpdateClients.constBegin(); it != m_outputUpdateClients.constEnd(); ++it) {
+        foreach (WebOSSurfaceItem *item, it.value().items) {
+            if (item->surface())
+                disconnect(item->surface(), &QWaylandSurface::sizeChanged, this, &WebOSCoreCompositor::onSurfaceSizeChanged);
+        }
     }
-    m_surfacesOnUpdate.clear();
+    m_outputUpdateClients.clear();
 }
 
 void WebOSCoreCompositor::onSurfaceSizeChanged()
@@ -732,12 +1205,73 @@ void WebOSCoreCompositor::onSurfaceSizeChanged()
 
     qDebug() << "OutputGeometry: size changed for item -" << item;
 
-    m_surfacesOnUpdate.removeOne(item);
-    disconnect(surface, &QWaylandSurface::sizeChanged, this, &WebOSCoreCompositor::onSurfaceSizeChanged);
-
     // We assume that if size is updated, output changes are applied to client.
-    if (m_surfacesOnUpdate.isEmpty())
+    removeFromOutputUpdate(item, true);
+}
+
+void WebOSCoreCompositor::removeFromOutputUpdate(WebOSSurfaceItem* item, bool acked)
+{
+    QHash<WaylandClient*, OutputUpdateClient>::iterator it;
+    for (it = m_outputUpdateClients.begin(); it != m_outputUpdateClients.end(); ++it) {
+        if (!it.value().items.removeOne(item))
+            continue;
+
+        if (item->surface())
+            disconnect(item->surface(), &QWaylandSurface::sizeChanged, this, &WebOSCoreCompositor::onSurfaceSizeChanged);
+
+        if (it.value().items.isEmpty()) {
+            if (acked) {
+                qint64 latency = m_outputUpdateTime.elapsed();
+                qInfo() << "OutputGeometry: output update" << m_outputUpdateSerial << "acked by client" << it.key()
+                    << "in" << latency << "ms";
+                m_outputUpdateAckLatency.insert(it.key(), latency);
+            }
+            m_outputUpdateClients.erase(it);
+            checkOutputUpdateDone();
+        }
+        return;
+    }
+}
+
+void WebOSCoreCompositor::checkOutputUpdateDone()
+{
+    if (m_outputUpdateClients.isEmpty()) {
+        m_outputUpdateDeadlineTimer.stop();
+        qInfo() << "OutputGeometry: output update" << m_outputUpdateSerial << "done in" << m_outputUpdateTime.elapsed() << "ms";
         emit outputUpdateDone();
+        return;
+    }
+
+    // Wake up at the nearest deadline
+    qint64 next = std::numeric_limits<qint64>::max();
+    foreach (const OutputUpdateClient &participant, m_outputUpdateClients)
+        next = qMin(next, participant.deadline);
+
+    m_outputUpdateDeadlineTimer.start(qMax<qint64>(0, next - m_outputUpdateTime.elapsed()));
+}
+
+void WebOSCoreCompositor::onOutputUpdateDeadline()
+{
+    qint64 elapsed = m_outputUpdateTime.elapsed();
+
+    QHash<WaylandClient*, OutputUpdateClient>::iterator it = m_outputUpdateClients.begin();
+    while (it != m_outputUpdateClients.end()) {
+        if (it.value().deadline > elapsed) {
+            ++it;
+            continue;
+        }
+
+        qWarning() << "OutputGeometry: client" << it.key() << "missed the deadline" << it.value().deadline
+            << "ms of output update" << m_outputUpdateSerial << ", not waiting for it anymore";
+        foreach (WebOSSurfaceItem *item, it.value().items) {
+            if (item->surface())
+                disconnect(item->surface(), &QWaylandSurface::sizeChanged, this, &WebOSCoreCompositor::onSurfaceSizeChanged);
+        }
+        m_outputUpdateAckLatency.insert(it.key(), it.value().deadline);
+        it = m_outputUpdateClients.erase(it);
+    }
+
+    checkOutputUpdateDone();
 }
 
 void WebOSCoreCompositor::initializeExtensions(WebOSCoreCompositor::ExtensionFlags extensions)
@@ -756,6 +1290,99 @@ void WebOSCoreCompositor::initTestPluginLoader()
     CompositorExtensionFactory::watchTestPluginDir();
 }
 
+CompositorExtension *WebOSCoreCompositor::loadExtension(const QString &key)
+{
+    PMTRACE_FUNCTION;
+    QElapsedTimer timer;
+    timer.start();
+    CompositorExtension *extension = CompositorExtensionFactory::create(this, key);
+    m_extensionLoadTimes.insert(key, timer.elapsed());
+
+    if (!extension) {
+        qWarning() << "Extension:" << key << "failed to load";
+        return 0;
+    }
+
+    qInfo() << "Extension:" << key << "loaded in" << m_extensionLoadTimes.value(key) << "ms";
+    if (m_keyFilter)
+        extension->installEventFilter(m_keyFilter);
+    m_extensions.insert(key, extension);
+    return extension;
+}
+
+void WebOSCoreCompositor::loadDeferredExtensions()
+{
+    while (!m_deferredExtensions.isEmpty())
+        loadExtension(m_deferredExtensions.takeFirst());
+}
+
+void WebOSCoreCompositor::onDeferredExtensionTimer()
+{
+    if (!m_deferredExtensions.isEmpty())
+        loadExtension(m_deferredExtensions.takeFirst());
+    if (!m_deferredExtensions.isEmpty())
+        m_deferredExtensionTimer.start();
+}
+
+QHash<QString, CompositorExtension *> WebOSCoreCompositor::extensions()
+{
+    // First use, whoever asks may be after the output or input of any
+    loadDeferredExtensions();
+    return m_extensions;
+}
+
+CompositorExtension *WebOSCoreCompositor::extension(const QString &key)
+{
+    if (m_extensions.contains(key))
+        return m_extensions.value(key);
+    if (m_deferredExtensions.removeAll(key) > 0)
+        return loadExtension(key);
+    return 0;
+}
+
+CompositorXOutput *WebOSCoreCompositor::xOutput()
+{
+    foreach (CompositorExtension *extension, m_extensions) {
+        if (CompositorXOutput *output = extension->xOutput())
+            return output;
+    }
+
+    if (m_deferredExtensions.isEmpty())
+        return 0;
+
+    // First use, the extension providing it may not be loaded yet
+    loadDeferredExtensions();
+    return xOutput();
+}
+
+CompositorXInput *WebOSCoreCompositor::xInput()
+{
+    foreach (CompositorExtension *extension, m_extensions) {
+        if (CompositorXInput *input = extension->xInput())
+            return input;
+    }
+
+    if (m_deferredExtensions.isEmpty())
+        return 0;
+
+    loadDeferredExtensions();
+    return xInput();
+}
+
+QVariantList WebOSCoreCompositor::extensionStatus() const
+{
+    QVariantList list;
+    foreach (const QString &key, CompositorExtensionFactory::requested()) {
+        QVariantMap status;
+        status.insert(QStringLiteral("name"), key);
+        status.insert(QStringLiteral("loaded"), m_extensions.contains(key));
+        status.insert(QStringLiteral("pending"), m_deferredExtensions.contains(key));
+        status.insert(QStringLiteral("loadTime"), m_extensionLoadTimes.value(key, -1));
+        list << status;
+    }
+    return list;
+}
+
 QList<QWaylandInputDevice *> WebOSCoreCompositor::inputDevices() const
 {
     return handle()->inputDevices();
@@ -823,3 +1450,107 @@ bool WebOSCoreCompositor::EventPreprocessor::eventFilter(QObject *obj, QEvent *e
 
     return eventAccepted;
 }
+
+void WebOSCoreCompositor::deferDelete(QObject *object, qint64 bytes)
+{
+    if (!object)
+        return;
+
+    // Take it off the scene now, only the deletion waits
+    QQuickItem *item = qobject_cast<QQuickItem *>(object);
+    if (item) {
+        item->setVisible(false);
+        item->setParentItem(NULL);
+    }
+
+    PendingDeletion pending = { object, bytes };
+    m_pendingDeletions << pending;
+    m_pendingDeletionBytes += bytes;
+    emit pendingDeletionChanged();
+
+    if (m_pendingDeletionBytes > m_reclaimLimit) {
+        qInfo() << "Reclaim:" << m_pendingDeletionBytes << "bytes pending, over the limit of" << m_reclaimLimit;
+        reclaimNow();
+    } else {
+        // Make sure there is a frame to reclaim at, or the timer if none comes
+        if (!m_reclaimTimer.isActive())
+            m_reclaimTimer.start();
+        if (window())
+            static_cast<QQuickWindow *>(window())->update();
+    }
+}
+
+void WebOSCoreCompositor::reclaimNow()
+{
+    reclaimResources(-1);
+}
+
+void WebOSCoreCompositor::reclaimResources(qint64 budget)
+{
+    PMTRACE_FUNCTION;
+
+    /* Process any "deleteLater" objects.
+       QtDeclarative defers to delete some objects including textures from image
+       and those of destroyed surface items. Those objects only can be removed
+       when control returns to the event loop. Otherwise we have to call
+       sendPostedEvents(QEvent::DeferredDelete) explicitly.
+       Please refer QObject::"deleteLater" for details.
+       It walks the whole event queue, so not on every frame unless we know
+       there is something to delete. */
+    if (m_flushDeferredDeletes || !m_pendingDeletions.isEmpty()
+        || !m_deferredDeleteTime.isValid() || m_deferredDeleteTime.hasExpired(ReclaimIdleInterval)) {
+        QCoreApplication::sendPostedEvents(0, QEvent::DeferredDelete);
+        m_deferredDeleteTime.start();
+        m_flushDeferredDeletes = false;
+    }
+
+    if (m_pendingDeletions.isEmpty()) {
+        m_reclaimTimer.stop();
+        return;
+    }
+
+    // At least one object per frame whatever its size
+    qint64 reclaimed = 0;
+    int count = 0;
+    while (!m_pendingDeletions.isEmpty() && (budget < 0 || count == 0 || reclaimed < budget)) {
+        PendingDeletion pending = m_pendingDeletions.takeFirst();
+        m_pendingDeletionBytes -= pending.bytes;
+        reclaimed += pending.bytes;
+        count++;
+        // Might have been deleted by its owner meanwhile
+        delete pending.object.data();
+    }
+
+    m_reclaimedBytes += reclaimed;
+    qDebug() << "Reclaim:" << count << "objects," << reclaimed << "bytes," << m_pendingDeletions.count() << "left";
+    emit pendingDeletionChanged();
+
+    if (m_pendingDeletions.isEmpty()) {
+        m_reclaimTimer.stop();
+    } else {
+        m_reclaimTimer.start();
+        if (window())
+            static_cast<QQuickWindow *>(window())->update();
+    }
+}
+
+void WebOSCoreCompositor::onReclaimTimer()
+{
+    reclaimResources(m_reclaimBudget);
+}
+
+void WebOSCoreCompositor::scheduleFrameReclaim()
+{
+    // Not while frameSwapped is being emitted, which is still within the
+    // render pass with the basic render loop
+    if (!m_frameReclaimQueued) {
+        m_frameReclaimQueued = true;
+        QMetaObject::invokeMethod(this, "onFrameReclaim", Qt::QueuedConnection);
+    }
+}
+
+void WebOSCoreCompositor::onFrameReclaim()
+{
+    m_frameReclaimQueued = false;
+    reclaimResources(m_reclaimBudget);
+}
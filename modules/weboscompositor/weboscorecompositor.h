@@ -21,7 +21,12 @@
 
 #include <QObject>
 #include <QList>
+#include <QHash>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QPointer>
 #include <QQuickWindow>
+#include <QVariantList>
 
 #include <qwaylandquickcompositor.h>
 #include <qwaylandquicksurface.h>
@@ -34,8 +39,12 @@ class WebOSInputMethod;
 class WebOSSurfaceModel;
 class WebOSSurfaceItem;
 class CompositorExtension;
+class CompositorXInput;
+class CompositorXOutput;
 class WebOSShell;
 class WebOSSurfaceGroupCompositor;
+class WebOSMemoryManager;
+class WebOSSnapshotCache;
 
 class WebOSInputManager;
 #ifdef MULTIINPUT_SUPPORT
@@ -57,6 +66,7 @@ class WEBOS_COMPOSITOR_EXPORT WebOSCoreCompositor : public QObject, public QWayl
     // property is introduced
     Q_PROPERTY(WebOSSurfaceItem* fullscreen READ fullscreen WRITE setFullscreen NOTIFY fullscreenChanged)
     Q_PROPERTY(QObject* window READ compositorWindow NOTIFY windowChanged)
+    Q_PROPERTY(int windowCount READ windowCount NOTIFY windowCountChanged)
 
     Q_PROPERTY(QSizeF output READ output WRITE setOutput NOTIFY outputChanged) // deprecated
 
@@ -68,6 +78,12 @@ class WEBOS_COMPOSITOR_EXPORT WebOSCoreCompositor : public QObject, public QWayl
 
     Q_PROPERTY(WebOSKeyFilter* keyFilter READ keyFilter WRITE setKeyFilter NOTIFY keyFilterChanged)
     Q_PROPERTY(WebOSSurfaceItem* activeSurface READ activeSurface NOTIFY activeSurfaceChanged)
+    Q_PROPERTY(WebOSMemoryManager* memoryManager READ memoryManager CONSTANT)
+    Q_PROPERTY(WebOSSnapshotCache* snapshotCache READ snapshotCache CONSTANT)
+    Q_PROPERTY(qint64 pendingDeletionBytes READ pendingDeletionBytes NOTIFY pendingDeletionChanged)
+    Q_PROPERTY(int pendingDeletionCount READ pendingDeletionCount NOTIFY pendingDeletionChanged)
+    Q_PROPERTY(qint64 reclaimedBytes READ reclaimedBytes NOTIFY pendingDeletionChanged)
+    Q_PROPERTY(bool viewsReady READ viewsReady NOTIFY viewsReadyChanged)
 public:
     enum ExtensionFlag {
         NoExtensions = 0x00,
@@ -110,6 +126,15 @@ public:
 #endif
     bool isMapped(WebOSSurfaceItem *item);
 
+    /*!
+     * Computes the part of \a item visible on its window and sends it to
+     * the client if it has changed. That is the item clipped by the window,
+     * by its clipping ancestors and less the opaque surface items stacked
+     * above it. Nothing is exposed unless the item is. Done for all the
+     * exposed items of a window after each of its frames.
+     */
+    void updateExposedRegion(WebOSSurfaceItem *item);
+
     bool cursorVisible() const { return m_cursorVisible; } // deprecated
     void setCursorVisible(bool visibility);
     Q_INVOKABLE void updateCursorFocus();
@@ -138,17 +163,66 @@ public:
     void setFullscreen(WebOSSurfaceItem* item);
     QObject* compositorWindow() const { return window(); }
 
+    /*!
+     * Adds a window for an extra display. Surface items are shown on the
+     * window of their display and get their textures updated and their
+     * frame callbacks sent by that window's render loop.
+     */
+    void registerWindow(QQuickWindow *window);
+    Q_INVOKABLE QObject* windowForDisplay(int displayId) const;
+    int windowCount() const { return m_windows.count(); }
+
+    /*!
+     * Tells the service manager that the compositor is ready, right away.
+     * With NOTIFY_SOCKET set, as systemd does, READY=1 is sent to it.
+     * Otherwise the lsm-ready upstart event is emitted, if built with
+     * upstart signaling.
+     */
     Q_INVOKABLE void emitLsmReady();
+    /*!
+     * Calls emitLsmReady() once the main window has swapped its first
+     * frame with QML loaded, that is once something can be displayed.
+     */
+    void emitLsmReadyOnFirstFrame();
+    /*!
+     * Whether the views of the primary window exist. Until then clients
+     * are served but surfaceMapped is held back, and emitted in order for
+     * the surfaces still mapped once the views become ready. Each is
+     * preceded by surfaceAdded of the window models created meanwhile, as
+     * when a surface is mapped with the views in place.
+     */
+    bool viewsReady() const { return m_viewsReady; }
+    void setViewsReady(bool ready);
+    /*! See WebOSStartupTracer::timeline() */
+    Q_INVOKABLE QVariantList startupTimeline() const;
 
     void setOutput(const QSizeF& size); // deprecated
     QSizeF output() const; // deprecated
 
-    int prepareOutputUpdate();
+    /*!
+     * Starts an output update transaction and returns the number of items
+     * taking part in it. A client acknowledges the update once all of its
+     * non-square surfaces have been resized. Each client has its own deadline,
+     * after which it is no longer waited for. That is \a timeout, extended
+     * for a client that took longer than half of it to acknowledge the
+     * previous update. outputUpdateDone is emitted as soon as no client is
+     * left to wait for.
+     */
+    int prepareOutputUpdate(int timeout = 0);
+    /*! Time in ms until the last deadline of the ongoing output update */
+    int outputUpdateTimeout() const;
     void commitOutputUpdate(QRect geometry, int rotation, double ratio);
     void finalizeOutputUpdate();
 
     void initTestPluginLoader();
 
+    /*!
+     * Returns "name", "loaded", "pending" and "loadTime" in ms for each
+     * extension in WEBOS_COMPOSITOR_EXTENSIONS. Pending ones are yet to
+     * be loaded and have no load time.
+     */
+    Q_INVOKABLE QVariantList extensionStatus() const;
+
     QList<QWaylandInputDevice *> inputDevices() const;
     QWaylandInputDevice *inputDeviceFor(QInputEvent *inputEvent) Q_DECL_OVERRIDE;
 
@@ -158,6 +232,24 @@ public:
     void setKeyFilter(WebOSKeyFilter *filter);
     WebOSSurfaceItem* activeSurface();
 
+    /*!
+     * Queues \a object to be deleted at the next frame boundary rather than
+     * right away. \a bytes is an estimate of the graphics memory it holds.
+     * Up to the per-frame budget is reclaimed each frame. Once the pending
+     * bytes exceed the limit everything is reclaimed at once.
+     */
+    void deferDelete(QObject *object, qint64 bytes);
+    /*!
+     * Deletes everything pending at once, to be used under memory pressure.
+     */
+    Q_INVOKABLE void reclaimNow();
+    WebOSMemoryManager* memoryManager() const { return m_memoryManager; }
+    WebOSSnapshotCache* snapshotCache() const { return m_snapshotCache; }
+    qint64 pendingDeletionBytes() const { return m_pendingDeletionBytes; }
+    int pendingDeletionCount() const { return m_pendingDeletions.count(); }
+    /*! Total bytes reclaimed through deferDelete so far */
+    qint64 reclaimedBytes() const { return m_reclaimedBytes; }
+
 public slots:
     void handleActiveFocusItemChanged();
 
@@ -184,6 +276,7 @@ signals:
     void itemUnexposed(QString &item);
 
     void windowChanged();
+    void windowCountChanged();
     void outputChanged(); // deprecated
 
     void cursorVisibleChanged(); // deprecated
@@ -198,11 +291,27 @@ signals:
 
     void outputUpdateDone();
 
+    void pendingDeletionChanged();
+    void viewsReadyChanged();
+
 protected:
     virtual void surfaceCreated(QWaylandSurface *surface);
 
     bool acquired() { return m_acquired; }
-    QHash<QString, CompositorExtension *> extensions() { return m_extensions; }
+    /*!
+     * Returns all the extensions, loading now those not needed at startup
+     * if they have not been yet. Otherwise these are loaded after the
+     * first frame, see CompositorExtensionFactory.
+     */
+    QHash<QString, CompositorExtension *> extensions();
+    /*! Returns the extension \a key, loading it now if deferred */
+    CompositorExtension *extension(const QString &key);
+    /*!
+     * Return the first extension output or input, loading the deferred
+     * extensions if none of the loaded ones has it.
+     */
+    CompositorXOutput *xOutput();
+    CompositorXInput *xInput();
 
 private:
     // This is kept here for backwards compatibility.. see the deprecated signal
@@ -215,6 +324,16 @@ private:
     /*! Holds the surfaces that have been mapped or are proxies */
     QList<WebOSSurfaceItem*> m_surfaces;
     QHash<QString, CompositorExtension *> m_extensions;
+    /*! Extensions to load after the first frame, in order */
+    QStringList m_deferredExtensions;
+    QHash<QString, qint64> m_extensionLoadTimes;
+    QTimer m_deferredExtensionTimer;
+
+    CompositorExtension *loadExtension(const QString &key);
+    void loadDeferredExtensions();
+
+    /*! Windows of all displays, the first one is window() */
+    QList<QQuickWindow*> m_windows;
 
     bool m_cursorVisible; // deprecated
     bool m_mouseEventEnabled;
@@ -226,8 +345,53 @@ private:
 #endif
     bool m_acquired;
     bool m_directRendering;
+    bool m_lsmReadyPending;
+    bool m_viewsReady;
+    /*! Mapped before the views were ready, in the order of mapping */
+    QList<QPointer<WebOSSurfaceItem> > m_pendingMappedItems;
+
+    struct OutputUpdateClient {
+        QList<WebOSSurfaceItem*> items;
+        qint64 deadline;
+    };
+
+    quint32 m_outputUpdateSerial;
+    QHash<WaylandClient*, OutputUpdateClient> m_outputUpdateClients;
+    /*! Time each client took to acknowledge the last output update */
+    QHash<WaylandClient*, qint64> m_outputUpdateAckLatency;
+    QElapsedTimer m_outputUpdateTime;
+    QTimer m_outputUpdateDeadlineTimer;
+
+    void removeFromOutputUpdate(WebOSSurfaceItem* item, bool acked);
+    void checkOutputUpdateDone();
+
+    struct PendingDeletion {
+        QPointer<QObject> object;
+        qint64 bytes;
+    };
 
-    QList<WebOSSurfaceItem*> m_surfacesOnUpdate;
+    QList<PendingDeletion> m_pendingDeletions;
+    qint64 m_pendingDeletionBytes;
+    qint64 m_reclaimedBytes;
+    /*! Bytes reclaimed per frame, a negative value means no limit */
+    qint64 m_reclaimBudget;
+    qint64 m_reclaimLimit;
+    /*! Reclaims when no frame is being rendered, active only while deletions are pending */
+    QTimer m_reclaimTimer;
+    /*! Set when objects are known to have been deferred for deletion */
+    bool m_flushDeferredDeletes;
+    QElapsedTimer m_deferredDeleteTime;
+    /*! Set while a reclaim after a frame is queued */
+    bool m_frameReclaimQueued;
+    WebOSMemoryManager* m_memoryManager;
+    WebOSSnapshotCache* m_snapshotCache;
+
+    void reclaimResources(qint64 budget);
+    void scheduleFrameReclaim();
+
+    void updateExposedRegions(QQuickWindow *window);
+    /*! The surface items of \a window hiding what is below them */
+    QList<WebOSSurfaceItem*> occluders(QQuickWindow *window) const;
 
     void setCursorSurface(QWaylandSurface *surface, int hotspotX, int hotspotY, WaylandClient *client);
 
@@ -269,8 +433,13 @@ private slots:
     void onSurfaceUnmapped();
     void onSurfaceDestroyed();
     void onSurfaceSizeChanged();
+    void onOutputUpdateDeadline();
+    void onReclaimTimer();
+    void onFrameReclaim();
+    void onDeferredExtensionTimer();
 
     void frameSwappedSlot(); //FIXME what for
+    void onSurfaceItemWindowChanged(QQuickWindow *window);
 
 public slots:
     bool setFullscreenSurface(QWaylandSurface *surface);
@@ -0,0 +1,567 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "webosmemorymanager.h"
+#include "weboscorecompositor.h"
+#include "webossurfaceitem.h"
+#include "webosscreenshot.h"
+#include "webossnapshotcache.h"
+#include "weboscompositortracer.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QPointer>
+#include <QQuickWindow>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QSGTextureProvider>
+#include <QStandardPaths>
+#include <QUrl>
+
+#include <qwaylandquicksurface.h>
+
+#include <algorithm>
+
+// Share of the last 10 seconds in % tasks were stalled on memory
+static const double PsiModerateThreshold = 10.0;
+static const double PsiCriticalThreshold = 20.0;
+// Intervals in ms
+static const int PressurePollInterval = 1000;
+static const int PressureEvaluateInterval = 2000;
+
+PsiPressureSource::PsiPressureSource(const QString &path, QObject *parent)
+    : MemoryPressureSource(parent)
+    , m_path(path)
+    , m_level(LevelNormal)
+{
+    m_pollTimer.setInterval(PressurePollInterval);
+    connect(&m_pollTimer, &QTimer::timeout, this, &PsiPressureSource::poll);
+    m_pollTimer.start();
+    poll();
+}
+
+bool PsiPressureSource::isAvailable(const QString &path)
+{
+    return QFileInfo(path).isReadable();
+}
+
+void PsiPressureSource::poll()
+{
+    QFile file(m_path);
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    // some avg10=0.00 avg60=0.00 avg300=0.00 total=0
+    // full avg10=0.00 avg60=0.00 avg300=0.00 total=0
+    Level level = LevelNormal;
+    foreach (const QByteArray &line, file.readAll().split('\n')) {
+        QList<QByteArray> fields = line.split(' ');
+        if (fields.count() < 2 || !fields[1].startsWith("avg10="))
+            continue;
+        double avg10 = fields[1].mid(6).toDouble();
+        if (fields[0] == "full" && avg10 >= PsiCriticalThreshold)
+            level = LevelCritical;
+        else if (fields[0] == "some" && avg10 >= PsiModerateThreshold && level < LevelModerate)
+            level = LevelModerate;
+    }
+
+    if (m_level != level) {
+        m_level = level;
+        emit levelChanged();
+    }
+}
+
+FilePressureSource::FilePressureSource(const QString &path, QObject *parent)
+    : MemoryPressureSource(parent)
+    , m_path(path)
+    , m_level(LevelNormal)
+{
+    m_pollTimer.setInterval(PressurePollInterval);
+    connect(&m_pollTimer, &QTimer::timeout, this, &FilePressureSource::poll);
+    m_pollTimer.start();
+    poll();
+}
+
+void FilePressureSource::poll()
+{
+    QFile file(m_path);
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    QByteArray value = file.readAll().trimmed();
+    Level level = LevelNormal;
+    if (value == "critical")
+        level = LevelCritical;
+    else if (value == "moderate")
+        level = LevelModerate;
+
+    if (m_level != level) {
+        m_level = level;
+        emit levelChanged();
+    }
+}
+
+// Has to run on the render thread as it deletes the texture. Dropping the
+// texture also lets go of the buffer, so the client can reuse or free it.
+class TextureReleaseJob : public QRunnable
+{
+public:
+    TextureReleaseJob(QWaylandQuickSurface *surface) : m_surface(surface) {}
+    void run() Q_DECL_OVERRIDE
+    {
+        if (m_surface)
+            m_surface->invalidateTexture();
+    }
+private:
+    QPointer<QWaylandQuickSurface> m_surface;
+};
+
+// Reads the texture of the target back. Runs after the sync while the GUI
+// thread still waits for it, so the target and its texture are safe to use
+// whichever render loop is in use.
+class SnapshotCaptureJob : public QRunnable
+{
+public:
+    SnapshotCaptureJob(WebOSMemoryManager *manager, int id, WebOSScreenShot *screenShot)
+        : m_manager(manager), m_id(id), m_screenShot(screenShot) {}
+    void run() Q_DECL_OVERRIDE
+    {
+        PMTRACE_FUNCTION;
+        QImage image;
+        WebOSSurfaceItem *target = m_screenShot->target();
+        if (target && target->surface() && target->textureProvider() && target->textureProvider()->texture()) {
+            image = QImage(target->surface()->size(), QImage::Format_ARGB32_Premultiplied);
+            ScreenShotTask task(m_screenShot, &image);
+            task.run();
+        }
+        QMetaObject::invokeMethod(m_manager, "onSnapshotCaptured", Qt::QueuedConnection, Q_ARG(int, m_id), Q_ARG(QImage, image));
+    }
+private:
+    WebOSMemoryManager *m_manager;
+    int m_id;
+    WebOSScreenShot *m_screenShot;
+};
+
+class SnapshotSaveJob : public QRunnable
+{
+public:
+    SnapshotSaveJob(WebOSMemoryManager *manager, int id, const QImage &image, const QString &path)
+        : m_manager(manager), m_id(id), m_image(image), m_path(path) {}
+    void run() Q_DECL_OVERRIDE
+    {
+        PMTRACE_FUNCTION;
+        // Renamed into place once complete, so no reader sees half a file
+        QSaveFile file(m_path);
+        bool saved = file.open(QIODevice::WriteOnly) && m_image.save(&file, "PNG") && file.commit();
+        if (!saved)
+            qWarning() << "MemoryManager: unable to save snapshot" << m_path << file.errorString();
+        QMetaObject::invokeMethod(m_manager, "onSnapshotSaved", Qt::QueuedConnection, Q_ARG(int, m_id), Q_ARG(bool, saved));
+    }
+private:
+    WebOSMemoryManager *m_manager;
+    int m_id;
+    QImage m_image;
+    QString m_path;
+};
+
+WebOSMemoryManager::WebOSMemoryManager(WebOSCoreCompositor *compositor)
+    : QObject(compositor)
+    , m_compositor(compositor)
+    , m_source(0)
+    , m_level(PressureNormal)
+    , m_nextSnapshotId(0)
+{
+    m_evaluateTimer.setInterval(PressureEvaluateInterval);
+    connect(&m_evaluateTimer, &QTimer::timeout, this, &WebOSMemoryManager::evaluate);
+
+    m_pool.setMaxThreadCount(1);
+
+    // Kept across restarts, unlike the tmpfs of the temporary directory
+    QString dir = QString::fromLocal8Bit(qgetenv("WEBOS_COMPOSITOR_SNAPSHOT_DIR"));
+    if (dir.isEmpty()) {
+        QString cache = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+        if (!cache.isEmpty())
+            dir = QDir(cache).filePath(QStringLiteral("snapshots"));
+    }
+    if (!dir.isEmpty() && QDir().mkpath(dir)) {
+        m_snapshotDir = dir;
+        // Named after items of a previous run, no item survives a restart
+        QDir snapshots(dir, QStringLiteral("snapshot-*.png"), QDir::NoSort, QDir::Files);
+        foreach (const QString &name, snapshots.entryList())
+            snapshots.remove(name);
+    } else {
+        qWarning() << "MemoryManager: no directory to keep snapshots in" << dir;
+    }
+
+    connect(compositor, &WebOSCoreCompositor::fullscreenChanged, this, &WebOSMemoryManager::onFullscreenChanged);
+
+    // "psi" (default if supported), "file:<path>" or "none"
+    QString source = QString::fromLocal8Bit(qgetenv("WEBOS_COMPOSITOR_MEMORY_PRESSURE"));
+    if (source.startsWith(QLatin1String("file:")))
+        setSource(new FilePressureSource(source.mid(5)));
+    else if (source == QLatin1String("psi") || (source.isEmpty() && PsiPressureSource::isAvailable()))
+        setSource(new PsiPressureSource());
+
+    qInfo() << "MemoryManager: pressure source" << m_source << "snapshots in" << m_snapshotDir;
+}
+
+WebOSMemoryManager::~WebOSMemoryManager()
+{
+    m_pool.waitForDone();
+}
+
+void WebOSMemoryManager::setSource(MemoryPressureSource *source)
+{
+    if (m_source == source)
+        return;
+
+    delete m_source;
+    m_source = source;
+
+    if (m_source) {
+        m_source->setParent(this);
+        connect(m_source, &MemoryPressureSource::levelChanged, this, &WebOSMemoryManager::onSourceLevelChanged);
+        onSourceLevelChanged();
+    }
+}
+
+void WebOSMemoryManager::onSourceLevelChanged()
+{
+    setLevel(static_cast<PressureLevel>(m_source->level()));
+}
+
+void WebOSMemoryManager::setLevel(PressureLevel level)
+{
+    if (m_level == level)
+        return;
+
+    qInfo() << "MemoryManager: pressure level" << m_level << "->" << level
+            << "buffers:" << bufferBytes() << "textures:" << textureBytes();
+    m_level = level;
+    emit levelChanged();
+
+    if (m_level == PressureNormal) {
+        m_evaluateTimer.stop();
+    } else {
+        m_evaluateTimer.start();
+        evaluate();
+    }
+}
+
+void WebOSMemoryManager::evaluate()
+{
+    PMTRACE_FUNCTION;
+    if (m_level == PressureNormal)
+        return;
+
+    m_compositor->reclaimNow();
+
+    // Ready for the cards that may have to become proxies. Their textures
+    // are kept until then as that is where the snapshot is taken from.
+    foreach (WebOSSurfaceItem *item, m_compositor->getItems()) {
+        if (isBackground(item) && item->cardSnapShotFilePath().isEmpty())
+            takeSnapshot(item);
+    }
+
+    if (m_level == PressureCritical)
+        convertToProxy();
+
+    releaseTextures();
+}
+
+static qint64 surfaceBytes(QWaylandSurface *surface)
+{
+    QSize size = surface->size();
+    return qint64(size.width()) * size.height() * 4;
+}
+
+qint64 WebOSMemoryManager::itemBufferBytes(WebOSSurfaceItem *item) const
+{
+    // Other buffers live on the client side, bound as a texture
+    if (!item || !item->surface() || item->surface()->type() != QWaylandSurface::Shm)
+        return 0;
+    return surfaceBytes(item->surface());
+}
+
+qint64 WebOSMemoryManager::itemTextureBytes(WebOSSurfaceItem *item) const
+{
+    if (!item || !item->surface() || m_released.contains(item->surface()))
+        return 0;
+    return surfaceBytes(item->surface());
+}
+
+qint64 WebOSMemoryManager::itemSnapshotBytes(WebOSSurfaceItem *item) const
+{
+    if (!item)
+        return 0;
+    QString path = item->cardSnapShotFilePath();
+    if (path.isEmpty() || !m_compositor->snapshotCache())
+        return 0;
+    // Only what is decoded takes memory, and the cache knows its size
+    return m_compositor->snapshotCache()->bytes(path);
+}
+
+qint64 WebOSMemoryManager::bufferBytes() const
+{
+    qint64 bytes = 0;
+    foreach (WebOSSurfaceItem *item, m_compositor->getItems())
+        bytes += itemBufferBytes(item);
+    return bytes;
+}
+
+qint64 WebOSMemoryManager::textureBytes() const
+{
+    qint64 bytes = 0;
+    foreach (WebOSSurfaceItem *item, m_compositor->getItems())
+        bytes += itemTextureBytes(item);
+    return bytes;
+}
+
+qint64 WebOSMemoryManager::snapshotBytes() const
+{
+    qint64 bytes = 0;
+    foreach (WebOSSurfaceItem *item, m_compositor->getItems())
+        bytes += itemSnapshotBytes(item);
+    return bytes;
+}
+
+QVariantMap WebOSMemoryManager::itemUsage(WebOSSurfaceItem *item) const
+{
+    QVariantMap usage;
+    addUsage(usage, item);
+    usage.remove(QStringLiteral("surfaces"));
+    return usage;
+}
+
+void WebOSMemoryManager::addUsage(QVariantMap &entry, WebOSSurfaceItem *item) const
+{
+    qint64 buffer = itemBufferBytes(item);
+    qint64 texture = itemTextureBytes(item);
+    qint64 snapshot = itemSnapshotBytes(item);
+
+    entry.insert(QStringLiteral("buffer"), entry.value(QStringLiteral("buffer")).toLongLong() + buffer);
+    entry.insert(QStringLiteral("texture"), entry.value(QStringLiteral("texture")).toLongLong() + texture);
+    entry.insert(QStringLiteral("snapshot"), entry.value(QStringLiteral("snapshot")).toLongLong() + snapshot);
+    entry.insert(QStringLiteral("total"), entry.value(QStringLiteral("total")).toLongLong() + buffer + texture + snapshot);
+    entry.insert(QStringLiteral("surfaces"), entry.value(QStringLiteral("surfaces")).toInt() + 1);
+}
+
+static QVariantList sortedByTotal(QList<QVariantMap> entries)
+{
+    std::sort(entries.begin(), entries.end(), [](const QVariantMap &a, const QVariantMap &b) {
+        return a.value(QStringLiteral("total")).toLongLong() > b.value(QStringLiteral("total")).toLongLong();
+    });
+
+    QVariantList list;
+    foreach (const QVariantMap &entry, entries)
+        list << entry;
+    return list;
+}
+
+QVariantList WebOSMemoryManager::clientUsage() const
+{
+    QHash<WaylandClient *, QVariantMap> clients;
+    foreach (WebOSSurfaceItem *item, m_compositor->getItems()) {
+        WaylandClient *client = item->surface() ? item->surface()->client() : 0;
+        if (!client)
+            continue;
+
+        QVariantMap &entry = clients[client];
+        if (entry.isEmpty())
+            entry.insert(QStringLiteral("pid"), int(item->pid()));
+        QStringList appIds = entry.value(QStringLiteral("appIds")).toStringList();
+        if (!appIds.contains(item->appId())) {
+            appIds << item->appId();
+            entry.insert(QStringLiteral("appIds"), appIds);
+        }
+        addUsage(entry, item);
+    }
+    return sortedByTotal(clients.values());
+}
+
+QVariantList WebOSMemoryManager::appUsage() const
+{
+    QHash<QString, QVariantMap> apps;
+    foreach (WebOSSurfaceItem *item, m_compositor->getItems()) {
+        QVariantMap &entry = apps[item->appId()];
+        if (entry.isEmpty())
+            entry.insert(QStringLiteral("appId"), item->appId());
+        addUsage(entry, item);
+    }
+    return sortedByTotal(apps.values());
+}
+
+bool WebOSMemoryManager::isReleasable(WebOSSurfaceItem *item) const
+{
+    if (!item->surface() || m_released.contains(item->surface()) || isSnapshotPending(item))
+        return false;
+
+    // Still drawn, e.g. as a thumbnail
+    if (item->window() && item->isVisible())
+        return false;
+
+    return item->isProxy() || !item->exposed() || item->state() == Qt::WindowMinimized;
+}
+
+bool WebOSMemoryManager::releaseTexture(WebOSSurfaceItem *item)
+{
+    if (!item || !isReleasable(item))
+        return false;
+
+    QQuickWindow *window = item->window() ? item->window() : static_cast<QQuickWindow *>(m_compositor->window());
+    if (!window)
+        return false;
+
+    QWaylandQuickSurface *surface = static_cast<QWaylandQuickSurface *>(item->surface());
+    window->scheduleRenderJob(new TextureReleaseJob(surface), QQuickWindow::BeforeSynchronizingStage);
+    window->update();
+
+    // Counted as released until the client commits a new buffer
+    m_released.insert(surface);
+    connect(surface, &QWaylandSurface::damaged, this, &WebOSMemoryManager::onSurfaceDamaged, Qt::UniqueConnection);
+    connect(surface, &QObject::destroyed, this, &WebOSMemoryManager::onSurfaceDestroyed, Qt::UniqueConnection);
+
+    qDebug() << "MemoryManager: released texture of" << item << item->appId() << itemBufferBytes(item) << "bytes";
+    emit usageChanged();
+    return true;
+}
+
+void WebOSMemoryManager::releaseTextures()
+{
+    foreach (WebOSSurfaceItem *item, m_compositor->getItems())
+        releaseTexture(item);
+}
+
+void WebOSMemoryManager::onSurfaceDamaged()
+{
+    QObject *surface = sender();
+    if (m_released.remove(surface)) {
+        disconnect(surface, 0, this, 0);
+        emit usageChanged();
+    }
+}
+
+void WebOSMemoryManager::onSurfaceDestroyed(QObject *surface)
+{
+    m_released.remove(surface);
+}
+
+bool WebOSMemoryManager::isBackground(WebOSSurfaceItem *item) const
+{
+    return item->surface() && item->surface()->client()
+        && !item->isProxy() && !item->isClosing()
+        && item->type() == QLatin1String("_WEBOS_WINDOW_TYPE_CARD")
+        && item != m_compositor->fullscreen()
+        && !item->exposed()
+        && !(item->window() && item->isVisible());
+}
+
+bool WebOSMemoryManager::convertToProxy()
+{
+    // The least recently used one goes first. The ones still being
+    // snapshotted wait for the next evaluation.
+    WebOSSurfaceItem *victim = 0;
+    foreach (WebOSSurfaceItem *item, m_compositor->getItems()) {
+        if (isBackground(item) && !isSnapshotPending(item)
+            && (!victim || item->lastFullscreenTick() < victim->lastFullscreenTick()))
+            victim = item;
+    }
+
+    if (!victim)
+        return false;
+
+    qInfo() << "MemoryManager: turning" << victim << victim->appId() << "into a proxy, snapshot:" << victim->cardSnapShotFilePath();
+    m_compositor->closeWindowKeepItem(QVariant::fromValue(victim));
+    return true;
+}
+
+void WebOSMemoryManager::onFullscreenChanged()
+{
+    // The card leaving the fullscreen is as it was last seen, so that is
+    // when to take the snapshot a proxy of it would show. Only under
+    // pressure, not to read back and write out a frame on every switch.
+    if (m_level > PressureNormal && m_fullscreen && m_fullscreen != m_compositor->fullscreen())
+        takeSnapshot(m_fullscreen);
+    m_fullscreen = m_compositor->fullscreen();
+}
+
+bool WebOSMemoryManager::isSnapshotPending(WebOSSurfaceItem *item) const
+{
+    foreach (const PendingSnapshot &pending, m_pendingSnapshots) {
+        if (pending.item == item)
+            return true;
+    }
+    return false;
+}
+
+bool WebOSMemoryManager::takeSnapshot(WebOSSurfaceItem *item)
+{
+    if (m_snapshotDir.isEmpty() || !item->surface() || item->isProxy() || item->isClosing()
+        || item->type() != QLatin1String("_WEBOS_WINDOW_TYPE_CARD")
+        || m_released.contains(item->surface()) || isSnapshotPending(item))
+        return false;
+
+    QQuickWindow *window = item->window() ? item->window() : static_cast<QQuickWindow *>(m_compositor->window());
+    if (!window)
+        return false;
+
+    PendingSnapshot pending;
+    pending.item = item;
+    pending.screenShot = new WebOSScreenShot;
+    pending.screenShot->setParent(this);
+    pending.screenShot->setTarget(item);
+    // One per item as an app may have several cards. The app id comes
+    // from the client, not to be taken as a path.
+    pending.path = QDir(m_snapshotDir).filePath(QStringLiteral("snapshot-%1-%2.png")
+        .arg(QString::fromLatin1(QUrl::toPercentEncoding(item->appId())),
+             QString::number(reinterpret_cast<quintptr>(item), 16)));
+
+    int id = m_nextSnapshotId++;
+    m_pendingSnapshots.insert(id, pending);
+
+    window->scheduleRenderJob(new SnapshotCaptureJob(this, id, pending.screenShot), QQuickWindow::AfterSynchronizingStage);
+    window->update();
+    return true;
+}
+
+void WebOSMemoryManager::onSnapshotCaptured(int id, const QImage &image)
+{
+    QHash<int, PendingSnapshot>::iterator it = m_pendingSnapshots.find(id);
+    if (it == m_pendingSnapshots.end())
+        return;
+
+    delete it->screenShot;
+    it->screenShot = 0;
+
+    if (image.isNull() || !it->item) {
+        m_pendingSnapshots.erase(it);
+        return;
+    }
+
+    m_pool.start(new SnapshotSaveJob(this, id, image, it->path));
+}
+
+void WebOSMemoryManager::onSnapshotSaved(int id, bool saved)
+{
+    PendingSnapshot pending = m_pendingSnapshots.take(id);
+    if (saved && pending.item) {
+        qDebug() << "MemoryManager: snapshot of" << pending.item << pending.item->appId() << "saved in" << pending.path;
+        pending.item->setCardSnapShotFilePath(pending.path);
+        emit usageChanged();
+    }
+}
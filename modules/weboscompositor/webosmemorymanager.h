@@ -0,0 +1,227 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef WEBOSMEMORYMANAGER_H
+#define WEBOSMEMORYMANAGER_H
+
+#include <QObject>
+#include <QHash>
+#include <QImage>
+#include <QPointer>
+#include <QSet>
+#include <QThreadPool>
+#include <QTimer>
+#include <QVariantMap>
+#include <QVariantList>
+
+#include <WebOSCoreCompositor/weboscompositorexport.h>
+
+class QWaylandSurface;
+class WebOSCoreCompositor;
+class WebOSScreenShot;
+class WebOSSurfaceItem;
+
+/*!
+ * Tells how short the system is on memory. Subclass it to feed the
+ * memory manager from something else than the default sources.
+ */
+class WEBOS_COMPOSITOR_EXPORT MemoryPressureSource : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Level {
+        LevelNormal = 0,
+        LevelModerate,
+        LevelCritical
+    };
+
+    MemoryPressureSource(QObject *parent = 0) : QObject(parent) {}
+
+    virtual Level level() const = 0;
+
+signals:
+    void levelChanged();
+};
+
+/*!
+ * Reads the pressure stall information of the kernel, /proc/pressure/memory.
+ * The level is moderate when some tasks have been stalled on memory for
+ * more than 10% of the last 10 seconds, critical when all of them have
+ * been for more than 20%.
+ */
+class WEBOS_COMPOSITOR_EXPORT PsiPressureSource : public MemoryPressureSource
+{
+    Q_OBJECT
+
+public:
+    PsiPressureSource(const QString &path = QLatin1String("/proc/pressure/memory"), QObject *parent = 0);
+
+    Level level() const Q_DECL_OVERRIDE { return m_level; }
+
+    static bool isAvailable(const QString &path = QLatin1String("/proc/pressure/memory"));
+
+private slots:
+    void poll();
+
+private:
+    QString m_path;
+    Level m_level;
+    QTimer m_pollTimer;
+};
+
+/*!
+ * Reads the level from a file holding "normal", "moderate" or "critical",
+ * for testing the memory policy without actually running out of memory.
+ */
+class WEBOS_COMPOSITOR_EXPORT FilePressureSource : public MemoryPressureSource
+{
+    Q_OBJECT
+
+public:
+    FilePressureSource(const QString &path, QObject *parent = 0);
+
+    Level level() const Q_DECL_OVERRIDE { return m_level; }
+
+private slots:
+    void poll();
+
+private:
+    QString m_path;
+    Level m_level;
+    QTimer m_pollTimer;
+};
+
+/*!
+ * Keeps track of the graphics memory held for surface items and reduces
+ * it as the memory pressure rises.
+ *
+ * At the moderate level, textures of items that are minimized, unexposed
+ * or proxies are released and pending deletions are reclaimed. At the
+ * critical level, the least recently used background app is additionally
+ * turned into a proxy item, one at a time for as long as the level stays
+ * critical.
+ *
+ * The snapshot shown for such a proxy is taken ahead of time while the
+ * level is above normal, when a card leaves the fullscreen and for
+ * background cards still without one. The texture is read back at the
+ * next sync and encoded on a worker thread, one file per item, into
+ * WEBOS_COMPOSITOR_SNAPSHOT_DIR or the cache location of the application.
+ */
+class WEBOS_COMPOSITOR_EXPORT WebOSMemoryManager : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(PressureLevel level READ level NOTIFY levelChanged)
+    Q_PROPERTY(qint64 bufferBytes READ bufferBytes NOTIFY usageChanged)
+    Q_PROPERTY(qint64 textureBytes READ textureBytes NOTIFY usageChanged)
+    Q_PROPERTY(qint64 snapshotBytes READ snapshotBytes NOTIFY usageChanged)
+
+public:
+    enum PressureLevel {
+        PressureNormal = MemoryPressureSource::LevelNormal,
+        PressureModerate = MemoryPressureSource::LevelModerate,
+        PressureCritical = MemoryPressureSource::LevelCritical
+    };
+    Q_ENUM(PressureLevel)
+
+    WebOSMemoryManager(WebOSCoreCompositor *compositor);
+    ~WebOSMemoryManager();
+
+    /*!
+     * Replaces the pressure source, the manager takes the ownership.
+     * Passing null leaves the level to setLevel().
+     */
+    void setSource(MemoryPressureSource *source);
+    MemoryPressureSource *source() const { return m_source; }
+
+    PressureLevel level() const { return m_level; }
+    /*! Overrides the level until the source reports a change */
+    Q_INVOKABLE void setLevel(PressureLevel level);
+
+    /*! Shm buffers attached to surfaces */
+    qint64 bufferBytes() const;
+    /*! Textures uploaded from or bound to surface buffers */
+    qint64 textureBytes() const;
+    /*! Decoded snapshot images of items held in the snapshot cache */
+    qint64 snapshotBytes() const;
+    /*!
+     * Returns the estimated "buffer", "texture", "snapshot" and "total"
+     * bytes of \a item.
+     */
+    Q_INVOKABLE QVariantMap itemUsage(WebOSSurfaceItem *item) const;
+    /*!
+     * Returns the usage of each client connected, the biggest first, with
+     * its "pid", "appIds" and number of "surfaces" along with the bytes as
+     * in itemUsage(). Usable as a model.
+     */
+    Q_INVOKABLE QVariantList clientUsage() const;
+    /*!
+     * Returns the usage of each app including its proxy items, the biggest
+     * first, with its "appId" and number of "surfaces" along with the bytes
+     * as in itemUsage(). Usable as a model.
+     */
+    Q_INVOKABLE QVariantList appUsage() const;
+
+    /*! Releases the texture of \a item if it is not shown */
+    Q_INVOKABLE bool releaseTexture(WebOSSurfaceItem *item);
+
+signals:
+    void levelChanged();
+    void usageChanged();
+
+private slots:
+    void onSourceLevelChanged();
+    void onSurfaceDamaged();
+    void onSurfaceDestroyed(QObject *surface);
+    void onFullscreenChanged();
+    void onSnapshotCaptured(int id, const QImage &image);
+    void onSnapshotSaved(int id, bool saved);
+    void evaluate();
+
+private:
+    bool isReleasable(WebOSSurfaceItem *item) const;
+    bool isBackground(WebOSSurfaceItem *item) const;
+    qint64 itemBufferBytes(WebOSSurfaceItem *item) const;
+    qint64 itemTextureBytes(WebOSSurfaceItem *item) const;
+    qint64 itemSnapshotBytes(WebOSSurfaceItem *item) const;
+    void addUsage(QVariantMap &entry, WebOSSurfaceItem *item) const;
+    void releaseTextures();
+    bool convertToProxy();
+    bool takeSnapshot(WebOSSurfaceItem *item);
+    bool isSnapshotPending(WebOSSurfaceItem *item) const;
+
+    WebOSCoreCompositor *m_compositor;
+    MemoryPressureSource *m_source;
+    PressureLevel m_level;
+    /*! Surfaces whose texture has been released until their next commit */
+    QSet<QObject *> m_released;
+    /*! Re-evaluates while the level stays above normal */
+    QTimer m_evaluateTimer;
+    QString m_snapshotDir;
+
+    struct PendingSnapshot {
+        QPointer<WebOSSurfaceItem> item;
+        WebOSScreenShot *screenShot;
+        QString path;
+    };
+    QHash<int, PendingSnapshot> m_pendingSnapshots;
+    int m_nextSnapshotId;
+    QPointer<WebOSSurfaceItem> m_fullscreen;
+    /*! Encodes snapshots, one at a time not to compete with clients */
+    QThreadPool m_pool;
+};
+
+#endif
@@ -0,0 +1,221 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "webossnapshotcache.h"
+#include "weboscompositortracer.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QQuickTextureFactory>
+#include <QQuickWindow>
+#include <QRunnable>
+
+// In KiB
+static const int SnapshotCacheDefaultSize = 32 * 1024;
+
+static const QString SnapshotUrlPrefix = QStringLiteral("image://snapshot/");
+
+class SnapshotPrefetchJob : public QRunnable
+{
+public:
+    SnapshotPrefetchJob(WebOSSnapshotCache *cache, const QString &path) : m_cache(cache), m_path(path) {}
+    void run() Q_DECL_OVERRIDE { m_cache->image(m_path); }
+private:
+    WebOSSnapshotCache *m_cache;
+    QString m_path;
+};
+
+class SnapshotDeleteJob : public QRunnable
+{
+public:
+    SnapshotDeleteJob(const QString &path, const QDateTime &modified) : m_path(path), m_modified(modified) {}
+    void run() Q_DECL_OVERRIDE
+    {
+        // Leave it if a new snapshot has been written to the same path
+        if (QFileInfo(m_path).lastModified() == m_modified)
+            QFile::remove(m_path);
+    }
+private:
+    QString m_path;
+    QDateTime m_modified;
+};
+
+class SnapshotTextureFactory : public QQuickTextureFactory
+{
+public:
+    SnapshotTextureFactory(const QImage &image) : m_image(image) {}
+
+    QSGTexture *createTexture(QQuickWindow *window) const Q_DECL_OVERRIDE { return window->createTextureFromImage(m_image); }
+    QSize textureSize() const Q_DECL_OVERRIDE { return m_image.size(); }
+    int textureByteCount() const Q_DECL_OVERRIDE { return m_image.byteCount(); }
+    QImage image() const Q_DECL_OVERRIDE { return m_image; }
+
+private:
+    QImage m_image;
+};
+
+WebOSSnapshotCache::WebOSSnapshotCache(QObject *parent)
+    : QObject(parent)
+    , m_hits(0)
+    , m_misses(0)
+{
+    bool ok = false;
+    int kbytes = qgetenv("WEBOS_COMPOSITOR_SNAPSHOT_CACHE_SIZE").toInt(&ok);
+    if (!ok || kbytes < 0)
+        kbytes = SnapshotCacheDefaultSize;
+    m_cache.setMaxCost(kbytes * 1024);
+
+    m_pool.setMaxThreadCount(1);
+}
+
+WebOSSnapshotCache::~WebOSSnapshotCache()
+{
+    // Pending deletes are still to be done
+    m_pool.waitForDone();
+}
+
+QImage WebOSSnapshotCache::decode(const QString &path)
+{
+    PMTRACE_FUNCTION;
+    QImageReader reader(path);
+    QImage image = reader.read();
+    if (image.isNull()) {
+        qWarning() << "SnapshotCache: failed to read" << path << reader.errorString();
+        return image;
+    }
+
+    if (image.hasAlphaChannel())
+        return image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    return image.convertToFormat(QImage::Format_RGB888);
+}
+
+QImage WebOSSnapshotCache::image(const QString &path)
+{
+    QDateTime modified = QFileInfo(path).lastModified();
+    if (!modified.isValid())
+        return QImage();
+
+    {
+        QMutexLocker locker(&m_mutex);
+        Entry *entry = m_cache.object(path);
+        if (entry && entry->modified == modified) {
+            m_hits++;
+            return entry->image;
+        }
+        m_misses++;
+    }
+
+    // Decoded without holding the lock so that other lookups go on
+    QImage image = decode(path);
+    if (image.isNull())
+        return image;
+
+    QMutexLocker locker(&m_mutex);
+    Entry *entry = new Entry;
+    entry->image = image;
+    entry->modified = modified;
+    // Deletes the entry itself if it alone exceeds the budget
+    m_cache.insert(path, entry, image.byteCount());
+    m_bytes.insert(path, image.byteCount());
+    // Forget the evicted ones
+    QHash<QString, qint64>::iterator it = m_bytes.begin();
+    while (it != m_bytes.end()) {
+        if (m_cache.contains(it.key()))
+            ++it;
+        else
+            it = m_bytes.erase(it);
+    }
+    return image;
+}
+
+void WebOSSnapshotCache::prefetch(const QString &path)
+{
+    if (path.isEmpty())
+        return;
+
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_cache.contains(path))
+            return;
+    }
+
+    m_pool.start(new SnapshotPrefetchJob(this, path));
+}
+
+void WebOSSnapshotCache::remove(const QString &path)
+{
+    if (path.isEmpty())
+        return;
+
+    {
+        QMutexLocker locker(&m_mutex);
+        m_cache.remove(path);
+        m_bytes.remove(path);
+    }
+
+    QDateTime modified = QFileInfo(path).lastModified();
+    if (modified.isValid())
+        m_pool.start(new SnapshotDeleteJob(path, modified));
+}
+
+qint64 WebOSSnapshotCache::bytes(const QString &path) const
+{
+    QMutexLocker locker(&m_mutex);
+    // contains() leaves the order of use as it is, unlike object()
+    return m_cache.contains(path) ? m_bytes.value(path) : 0;
+}
+
+QUrl WebOSSnapshotCache::url(const QString &path)
+{
+    if (path.isEmpty())
+        return QUrl();
+    // The provider gets the id without the leading slash
+    return QUrl(SnapshotUrlPrefix + QFileInfo(path).absoluteFilePath().mid(1));
+}
+
+QVariantMap WebOSSnapshotCache::stats() const
+{
+    QMutexLocker locker(&m_mutex);
+    QVariantMap stats;
+    stats.insert(QStringLiteral("bytes"), m_cache.totalCost());
+    stats.insert(QStringLiteral("budget"), m_cache.maxCost());
+    stats.insert(QStringLiteral("count"), m_cache.count());
+    stats.insert(QStringLiteral("hits"), m_hits);
+    stats.insert(QStringLiteral("misses"), m_misses);
+    return stats;
+}
+
+SnapshotImageProvider::SnapshotImageProvider(WebOSSnapshotCache *cache)
+    : QQuickImageProvider(QQuickImageProvider::Texture, QQmlImageProviderBase::ForceAsynchronousImageLoading)
+    , m_cache(cache)
+{
+}
+
+QQuickTextureFactory *SnapshotImageProvider::requestTexture(const QString &id, QSize *size, const QSize &requestedSize)
+{
+    Q_UNUSED(requestedSize);
+
+    QImage image = m_cache->image(QLatin1Char('/') + id);
+    if (size)
+        *size = image.size();
+    if (image.isNull())
+        return 0;
+
+    // Shares the pixels with the cache
+    return new SnapshotTextureFactory(image);
+}
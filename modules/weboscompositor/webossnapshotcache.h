@@ -0,0 +1,104 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef WEBOSSNAPSHOTCACHE_H
+#define WEBOSSNAPSHOTCACHE_H
+
+#include <QObject>
+#include <QCache>
+#include <QDateTime>
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QThreadPool>
+#include <QUrl>
+#include <QVariantMap>
+#include <QQuickImageProvider>
+
+#include <WebOSCoreCompositor/weboscompositorexport.h>
+
+/*!
+ * Keeps decoded card snapshots in memory up to a byte budget, evicting the
+ * least recently used ones first. Snapshots are shown through the
+ * "image://snapshot" provider, so all items showing the same snapshot share
+ * one texture, and are decoded off the GUI thread.
+ *
+ * The budget is WEBOS_COMPOSITOR_SNAPSHOT_CACHE_SIZE in KiB, 32 MiB by
+ * default. Opaque snapshots are stored as RGB888 to take 3/4 of the memory.
+ */
+class WEBOS_COMPOSITOR_EXPORT WebOSSnapshotCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    WebOSSnapshotCache(QObject *parent = 0);
+    ~WebOSSnapshotCache();
+
+    /*!
+     * Returns the snapshot at \a path, decoding it in the calling thread if
+     * it is not cached or the file has changed since. Thread-safe.
+     */
+    QImage image(const QString &path);
+    /*! Decodes the snapshot at \a path into the cache on a worker thread */
+    void prefetch(const QString &path);
+    /*! Drops the snapshot at \a path and deletes the file on a worker thread */
+    void remove(const QString &path);
+    /*!
+     * Returns the bytes the snapshot at \a path takes decoded, 0 if it is
+     * not in the cache. Does not count as a use of it. Thread-safe.
+     */
+    qint64 bytes(const QString &path) const;
+
+    /*! Returns the url to show the snapshot at \a path with */
+    static QUrl url(const QString &path);
+
+    /*! Returns the "bytes", "budget", "count", "hits" and "misses" */
+    Q_INVOKABLE QVariantMap stats() const;
+
+private:
+    struct Entry {
+        QImage image;
+        QDateTime modified;
+    };
+
+    static QImage decode(const QString &path);
+
+    mutable QMutex m_mutex;
+    QCache<QString, Entry> m_cache;
+    /*! Bytes by path, valid for the paths still in m_cache */
+    QHash<QString, qint64> m_bytes;
+    quint64 m_hits;
+    quint64 m_misses;
+    /*! Single thread so that a delete never overtakes a decode */
+    QThreadPool m_pool;
+};
+
+/*!
+ * Serves "image://snapshot/<path>" from the snapshot cache. Requests are
+ * made on the loader thread of the QML engine.
+ */
+class SnapshotImageProvider : public QQuickImageProvider
+{
+public:
+    SnapshotImageProvider(WebOSSnapshotCache *cache);
+
+    QQuickTextureFactory *requestTexture(const QString &id, QSize *size, const QSize &requestedSize) Q_DECL_OVERRIDE;
+
+private:
+    WebOSSnapshotCache *m_cache;
+};
+
+#endif
@@ -0,0 +1,123 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "webosstartuptracer.h"
+#include "weboscompositortracer.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QThread>
+#include <QVariantMap>
+#include <QVector>
+
+namespace {
+
+struct Phase {
+    const char *name;
+    Qt::HANDLE thread;
+    qint64 start;
+    qint64 end;
+};
+
+struct Timeline {
+    Timeline() : mainThread(QThread::currentThreadId()) { clock.start(); }
+
+    QMutex mutex;
+    QElapsedTimer clock;
+    Qt::HANDLE mainThread;
+    QVector<Phase> phases;
+};
+
+}
+
+Q_GLOBAL_STATIC(Timeline, startupTimeline)
+
+void WebOSStartupTracer::start()
+{
+    QMutexLocker locker(&startupTimeline()->mutex);
+    startupTimeline()->mainThread = QThread::currentThreadId();
+    startupTimeline()->clock.restart();
+}
+
+void WebOSStartupTracer::begin(const char *phase)
+{
+    PMTRACE_BEFORE(const_cast<char *>(phase));
+    Timeline *t = startupTimeline();
+    QMutexLocker locker(&t->mutex);
+    Phase p = { phase, QThread::currentThreadId(), t->clock.elapsed(), -1 };
+    t->phases.append(p);
+}
+
+void WebOSStartupTracer::end(const char *phase)
+{
+    PMTRACE_AFTER(const_cast<char *>(phase));
+    Timeline *t = startupTimeline();
+    QMutexLocker locker(&t->mutex);
+    Qt::HANDLE thread = QThread::currentThreadId();
+    // The latest one of that name in this thread, phases may nest
+    for (int i = t->phases.count() - 1; i >= 0; i--) {
+        Phase &p = t->phases[i];
+        if (p.end < 0 && p.thread == thread && qstrcmp(p.name, phase) == 0) {
+            p.end = t->clock.elapsed();
+            return;
+        }
+    }
+    qWarning() << "Startup: no phase" << phase << "to end";
+}
+
+void WebOSStartupTracer::mark(const char *event)
+{
+    PMTRACE(const_cast<char *>(event));
+    Timeline *t = startupTimeline();
+    QMutexLocker locker(&t->mutex);
+    qint64 now = t->clock.elapsed();
+    Phase p = { event, QThread::currentThreadId(), now, now };
+    t->phases.append(p);
+}
+
+QVariantList WebOSStartupTracer::timeline()
+{
+    Timeline *t = startupTimeline();
+    QMutexLocker locker(&t->mutex);
+    // The origin of the timeline on the monotonic clock, that is since boot
+    qint64 origin = t->clock.msecsSinceReference();
+
+    QVariantList list;
+    foreach (const Phase &p, t->phases) {
+        QVariantMap entry;
+        entry.insert(QStringLiteral("phase"), QString::fromLatin1(p.name));
+        entry.insert(QStringLiteral("thread"), p.thread == t->mainThread ?
+            QStringLiteral("main") : QString::number(quintptr(p.thread), 16));
+        entry.insert(QStringLiteral("start"), p.start);
+        entry.insert(QStringLiteral("duration"), p.end < 0 ? -1 : p.end - p.start);
+        entry.insert(QStringLiteral("boot"), origin + p.start);
+        list << entry;
+    }
+    return list;
+}
+
+void WebOSStartupTracer::dump()
+{
+    foreach (const QVariant &v, timeline()) {
+        QVariantMap entry = v.toMap();
+        qInfo().nospace() << "Startup: " << qPrintable(entry.value(QStringLiteral("phase")).toString())
+            << " [" << qPrintable(entry.value(QStringLiteral("thread")).toString()) << "]"
+            << " at " << entry.value(QStringLiteral("start")).toLongLong() << " ms"
+            << " took " << entry.value(QStringLiteral("duration")).toLongLong() << " ms"
+            << " (" << entry.value(QStringLiteral("boot")).toLongLong() << " ms since boot)";
+    }
+}
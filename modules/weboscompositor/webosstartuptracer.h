@@ -0,0 +1,71 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef WEBOSSTARTUPTRACER_H
+#define WEBOSSTARTUPTRACER_H
+
+#include <QVariantList>
+
+#include <WebOSCoreCompositor/weboscompositorexport.h>
+
+/*!
+ * Records the timeline of the startup phases, from any thread, so that the
+ * time to the first frame can be broken down. Times are in ms since the
+ * tracer was started, and also since boot on the monotonic clock.
+ *
+ * Phases are also traced with PMTRACE_BEFORE/AFTER when lttng is enabled.
+ * The timeline is printed at the first frame when
+ * WEBOS_COMPOSITOR_STARTUP_TRACE is set, and can be queried at any time
+ * with WebOSCoreCompositor::startupTimeline().
+ */
+class WEBOS_COMPOSITOR_EXPORT WebOSStartupTracer
+{
+public:
+    /*! Sets the origin of the timeline, to be called first thing in main */
+    static void start();
+
+    static void begin(const char *phase);
+    static void end(const char *phase);
+    /*! Records an instant event such as the first frame */
+    static void mark(const char *event);
+
+    /*!
+     * Returns the phases in the order they began, each with "phase",
+     * "thread", "start", "duration" and "boot". The duration of a phase
+     * still running is -1.
+     */
+    static QVariantList timeline();
+    /*! Prints the timeline to the log */
+    static void dump();
+};
+
+/*!
+ * Traces the enclosing scope as a startup phase.
+ */
+class WebOSStartupPhase
+{
+public:
+    WebOSStartupPhase(const char *phase) : m_phase(phase) { WebOSStartupTracer::begin(m_phase); }
+    ~WebOSStartupPhase() { WebOSStartupTracer::end(m_phase); }
+
+private:
+    const char *m_phase;
+
+    WebOSStartupPhase(const WebOSStartupPhase&);
+    WebOSStartupPhase& operator=(const WebOSStartupPhase&);
+};
+
+#endif
@@ -23,12 +23,15 @@
 #include "weboscompositortracer.h"
 #include "webosshellsurface.h"
 #include "webosinputmethod.h"
+#include "webossnapshotcache.h"
 #ifdef MULTIINPUT_SUPPORT
 #include "webosinputdevice.h"
 #endif
 #include <QDateTime>
 #include <QQmlEngine>
-#include <QOpenGLTexture>
+#include <QQmlPropertyMap>
+#include <QCache>
+#include <QHash>
 #include <QDebug>
 
 #include <qweboskeyextension.h>
@@ -39,6 +42,60 @@
 
 #include "weboscompositortracer.h"
 
+/*
+ * Window types repeat across items and are compared a lot, so items share a
+ * single copy of each known type. Anything else comes from the client as is,
+ * not to keep every value a client ever sent.
+ */
+static QString internType(const QString &type)
+{
+    static const QStringList types = QStringList()
+        << QStringLiteral("_WEBOS_WINDOW_TYPE_CARD")
+        << QStringLiteral("_WEBOS_WINDOW_TYPE_KEYBOARD")
+        << QStringLiteral("_WEBOS_WINDOW_TYPE_OVERLAY")
+        << QStringLiteral("_WEBOS_WINDOW_TYPE_POPUP")
+        << QStringLiteral("_WEBOS_WINDOW_TYPE_RESTRICTED");
+    int index = types.indexOf(type);
+    return index >= 0 ? types.at(index) : type;
+}
+
+static pid_t clientPid(QWaylandSurface *surface)
+{
+    pid_t pid = getpid();
+    struct wl_client *client = surface ? static_cast<struct wl_client *>(surface->client()) : NULL;
+    if (client)
+        wl_client_get_credentials(client, &pid, 0, 0);
+    return pid;
+}
+
+// The shortest time between two exposed regions sent to a client
+static const int ExposedRegionInterval = 100;
+
+static bool touchDisabled()
+{
+    static const bool disabled = !qgetenv("WEBOS_DISABLE_TOUCH").isEmpty();
+    return disabled;
+}
+
+/*
+ * Window properties only change on request of the client, so a value written
+ * from QML is refused before it is stored and nobody sees it change.
+ * Changes made with insert() and clear() do not go through updateValue().
+ */
+class ReadOnlyPropertyMap : public QQmlPropertyMap
+{
+public:
+    ReadOnlyPropertyMap(QObject *parent) : QQmlPropertyMap(parent) {}
+
+protected:
+    QVariant updateValue(const QString &key, const QVariant &input) Q_DECL_OVERRIDE
+    {
+        Q_UNUSED(input);
+        qWarning() << "window properties are read-only, ignoring change of" << key;
+        return value(key);
+    }
+};
+
 WebOSSurfaceItem::WebOSSurfaceItem(WebOSCoreCompositor* compositor, QWaylandQuickSurface* surface)
         : QWaylandSurfaceItem(surface)
         , m_compositor(compositor)
@@ -47,31 +104,36 @@ WebOSSurfaceItem::WebOSSurfaceItem(WebOSCoreCompositor* compositor, QWaylandQuic
         , m_transientModel(0)
         , m_groupedWindowModel(0)
         , m_cardSnapShotFilePath()
-        , m_customImageFilePath(QLatin1String("none"))
+        , m_customImageFilePath(QStringLiteral("none"))
         , m_backgroundImageFilePath()
-        , m_backgroundColor("")
+        , m_backgroundColor()
         , m_shellSurface(0)
+        , m_windowPropertyMap(0)
         , m_itemState(ItemStateNormal)
         , m_notifyPositionToClient(true)
-        , m_appId("")
-        , m_type("_WEBOS_WINDOW_TYPE_CARD")
+        , m_appId()
+        , m_type(internType(QStringLiteral("_WEBOS_WINDOW_TYPE_CARD")))
         , m_windowClass(WindowClass_Normal)
-        , m_title("")
-        , m_subtitle("")
-        , m_params("")
-        , m_processId()
+        , m_title()
+        , m_subtitle()
+        , m_params()
+        , m_processId(clientPid(surface))
         , m_exposed(false)
+        , m_opaque(false)
         , m_launchRequired(false)
+        , m_displayAffinity(0)
         , m_surfaceGroup(0)
         , m_hasKeyboardFocus(false)
         , m_grabKeyboardFocusOnClick(true)
 {
     if (surface) {
-        connect(surface, SIGNAL(damaged(const QRegion &)), this, SLOT(onSurfaceDamaged(const QRegion &)));
+        connect(surface, &QWaylandSurface::damaged, this, &WebOSSurfaceItem::onSurfaceDamaged);
     }
 
-    connect(this, &QQuickItem::xChanged, this, &WebOSSurfaceItem::updateScreenPosition);
-    connect(this, &QQuickItem::yChanged, this, &WebOSSurfaceItem::updateScreenPosition);
+    m_exposedRegionTimer.setSingleShot(true);
+    m_exposedRegionTimer.setInterval(ExposedRegionInterval);
+    connect(&m_exposedRegionTimer, &QTimer::timeout, this, &WebOSSurfaceItem::sendExposedRegion);
+
     // Set the ownership as CppOwnership explicitly to prevent from garbage collecting by JS engine
     QQmlEngine::setObjectOwnership((QObject*)this, QQmlEngine::CppOwnership);
 
@@ -79,10 +141,7 @@ WebOSSurfaceItem::WebOSSurfaceItem(WebOSCoreCompositor* compositor, QWaylandQuic
     //it can restore the cursor from the system ui's cursor. See QQuickWindowPrivate::updateCursor()
     setCursor(Qt::ArrowCursor);
 
-    if (!qgetenv("WEBOS_DISABLE_TOUCH").isEmpty())
-        setTouchEventsEnabled(false);
-    else
-        setTouchEventsEnabled(true);
+    setTouchEventsEnabled(!touchDisabled());
 }
 
 WebOSSurfaceItem::~WebOSSurfaceItem()
@@ -420,6 +479,46 @@ QVariantMap WebOSSurfaceItem::windowProperties()
     return surface()->windowProperties();
 }
 
+QObject *WebOSSurfaceItem::windowPropertyMap()
+{
+    if (!m_windowPropertyMap) {
+        m_windowPropertyMap = new ReadOnlyPropertyMap(this);
+        resetWindowPropertyMap();
+    }
+    return m_windowPropertyMap;
+}
+
+void WebOSSurfaceItem::updateWindowPropertyMap(const QString &key, const QVariant &value)
+{
+    if (!m_windowPropertyMap)
+        return;
+
+    // Notifies the bindings on the key only if the value is different
+    if (value.isNull())
+        m_windowPropertyMap->clear(key);
+    else
+        m_windowPropertyMap->insert(key, value);
+}
+
+void WebOSSurfaceItem::resetWindowPropertyMap()
+{
+    if (!m_windowPropertyMap)
+        return;
+
+    QVariantMap properties;
+    if (m_shellSurface)
+        properties = m_shellSurface->properties();
+    else if (isSurfaced())
+        properties = surface()->windowProperties();
+
+    foreach (const QString &key, m_windowPropertyMap->keys()) {
+        if (!properties.contains(key))
+            m_windowPropertyMap->clear(key);
+    }
+    for (QVariantMap::const_iterator it = properties.constBegin(); it != properties.constEnd(); ++it)
+        m_windowPropertyMap->insert(it.key(), it.value());
+}
+
 void WebOSSurfaceItem::setWindowProperty(const QString& key, const QVariant& value)
 {
     if (m_shellSurface) {
@@ -432,27 +531,57 @@ void WebOSSurfaceItem::setWindowProperty(const QString& key, const QVariant& val
         }
         surface()->setWindowProperty(key, value);
     }
+    updateWindowPropertyMap(key, value);
+}
+
+typedef void (*WindowPropertyHandler)(WebOSSurfaceItem *item, const QVariant &value);
+
+/*!
+ * Window properties mirrored by the item, they are in the map already
+ */
+static const QHash<QString, WindowPropertyHandler> &windowPropertyHandlers()
+{
+    static QHash<QString, WindowPropertyHandler> handlers;
+    if (handlers.isEmpty()) {
+        handlers.insert(QStringLiteral("appId"), [](WebOSSurfaceItem *item, const QVariant &value) {
+            item->setAppId(value.toString(), false);
+        });
+        handlers.insert(QStringLiteral("_WEBOS_WINDOW_TYPE"), [](WebOSSurfaceItem *item, const QVariant &value) {
+            item->setType(value.toString(), false);
+        });
+        handlers.insert(QStringLiteral("_WEBOS_WINDOW_CLASS"), [](WebOSSurfaceItem *item, const QVariant &value) {
+            item->setWindowClass(WebOSSurfaceItem::WindowClass(value.toInt()), false);
+        });
+        handlers.insert(QStringLiteral("title"), [](WebOSSurfaceItem *item, const QVariant &value) {
+            item->setTitle(value.toString(), false);
+        });
+        handlers.insert(QStringLiteral("subtitle"), [](WebOSSurfaceItem *item, const QVariant &value) {
+            item->setSubtitle(value.toString(), false);
+        });
+        handlers.insert(QStringLiteral("params"), [](WebOSSurfaceItem *item, const QVariant &value) {
+            item->setParams(value.toString(), false);
+        });
+        handlers.insert(QStringLiteral("displayAffinity"), [](WebOSSurfaceItem *item, const QVariant &value) {
+            item->setDisplayAffinity(value.toInt(), false);
+        });
+    }
+    return handlers;
 }
 
-void WebOSSurfaceItem::updateProperties(const QVariantMap &properties, const QString &name, const QVariant &value)
+void WebOSSurfaceItem::updateProperties(const QVariantMap &properties, const QStringList &changed)
 {
     if (!surface()) {
-        qWarning() << "ignoring property for an unsurfaced item" << this << name;
+        qWarning() << "ignoring properties for an unsurfaced item" << this << changed;
         return;
     }
 
-    if (name == QLatin1String("appId")) {
-        setAppId(value.toString());
-    } else if (name == QLatin1String("_WEBOS_WINDOW_TYPE")) {
-        setType(value.toString());
-    } else if (name == QLatin1String("_WEBOS_WINDOW_CLASS")) {
-        setWindowClass(WebOSSurfaceItem::WindowClass(value.toInt()), false);
-    } else if (name == QLatin1String("title")) {
-        setTitle(value.toString(), false);
-    } else if (name == QLatin1String("subtitle")) {
-        setSubtitle(value.toString(), false);
-    } else if (name == QLatin1String("params")) {
-        setParams(value.toString());
+    const QHash<QString, WindowPropertyHandler> &handlers = windowPropertyHandlers();
+    foreach (const QString &name, changed) {
+        const QVariant value = properties.value(name);
+        WindowPropertyHandler handler = handlers.value(name);
+        if (handler)
+            handler(this, value);
+        updateWindowPropertyMap(name, value);
     }
 
     emit windowPropertiesChanged(properties);
@@ -474,7 +603,7 @@ void WebOSSurfaceItem::setType(const QString& type, bool updateProperty)
 {
     PMTRACE_FUNCTION;
     if (m_type != type) {
-        m_type = type;
+        m_type = internType(type);
         setObjectName(QString("surfaceItem_%1%2").arg(appId()).arg(m_type));
         emit typeChanged();
         if (updateProperty)
@@ -573,6 +702,11 @@ void WebOSSurfaceItem::setCardSnapShotFilePath(const QString& fPath)
     }
 }
 
+QUrl WebOSSurfaceItem::cardSnapShotUrl()
+{
+    return WebOSSnapshotCache::url(m_cardSnapShotFilePath);
+}
+
 void WebOSSurfaceItem::setCustomImageFilePath(QString filePath)
 {
     if (m_customImageFilePath != filePath) {
@@ -606,9 +740,13 @@ void WebOSSurfaceItem::deleteSnapShot()
         return;
     }
 
-    QFile oldFile(filepath);
-    if (oldFile.exists()) {
-        oldFile.remove();
+    if (m_compositor) {
+        m_compositor->snapshotCache()->remove(filepath);
+    } else {
+        QFile oldFile(filepath);
+        if (oldFile.exists()) {
+            oldFile.remove();
+        }
     }
 }
 
@@ -664,8 +802,8 @@ void WebOSSurfaceItem::setShellSurface(WebOSShellSurface* shell)
         connect(m_shellSurface, SIGNAL(locationHintChanged()), this, SIGNAL(locationHintChanged()));
         connect(m_shellSurface, SIGNAL(keyMaskChanged()), this, SIGNAL(keyMaskChanged()));
         connect(m_shellSurface, SIGNAL(stateChangeRequested(Qt::WindowState)), this, SLOT(requestStateChange(Qt::WindowState)));
-        connect(m_shellSurface, SIGNAL(propertiesChanged(QVariantMap, QString, QVariant)),
-                this, SLOT(updateProperties(QVariantMap, QString, QVariant)));
+        connect(m_shellSurface, &WebOSShellSurface::propertiesChanged, this, &WebOSSurfaceItem::updateProperties);
+        resetWindowPropertyMap();
     }
 }
 
@@ -693,6 +831,14 @@ void WebOSSurfaceItem::setItemState(ItemState state)
     }
 }
 
+void WebOSSurfaceItem::geometryChanged(const QRectF &newGeometry, const QRectF &oldGeometry)
+{
+    QWaylandSurfaceItem::geometryChanged(newGeometry, oldGeometry);
+    // Instead of connecting to xChanged and yChanged in every item
+    if (newGeometry.topLeft() != oldGeometry.topLeft())
+        updateScreenPosition();
+}
+
 void WebOSSurfaceItem::updateScreenPosition()
 {
     if (m_shellSurface && m_notifyPositionToClient) {
@@ -758,17 +904,46 @@ void WebOSSurfaceItem::setNotifyPositionToClient(bool notify)
 void WebOSSurfaceItem::setExposed(bool exposed)
 {
     if (m_exposed != exposed) {
-        if (m_shellSurface && surface()) {
-            QRegion r = exposed ? QRegion(QRect(QPoint(0, 0), surface()->size())) : QRegion();
-            m_shellSurface->exposed(r);
-        } else {
-            qWarning("no surface or shellSurface, no one to send to.");
-        }
         m_exposed = exposed;
+        // Sent right away rather than at the next frame
+        m_compositor->updateExposedRegion(this);
         emit exposedChanged();
     }
 }
 
+void WebOSSurfaceItem::setExposedRegion(const QRegion &region, bool immediate)
+{
+    m_pendingExposedRegion = region;
+    // Otherwise sent when the timer expires
+    if (immediate || !m_exposedRegionTimer.isActive())
+        sendExposedRegion();
+}
+
+void WebOSSurfaceItem::sendExposedRegion()
+{
+    if (m_exposedRegion == m_pendingExposedRegion)
+        return;
+
+    if (m_shellSurface && surface()) {
+        m_shellSurface->exposed(m_pendingExposedRegion);
+    } else {
+        qWarning("no surface or shellSurface, no one to send to.");
+    }
+    m_exposedRegion = m_pendingExposedRegion;
+    m_exposedRegionTimer.start();
+}
+
+void WebOSSurfaceItem::setOpaque(bool opaque)
+{
+    if (m_opaque != opaque) {
+        m_opaque = opaque;
+        emit opaqueChanged();
+        // For the exposed regions to be updated
+        if (window())
+            window()->update();
+    }
+}
+
 void WebOSSurfaceItem::setLaunchRequired(bool required)
 {
     if (m_launchRequired != required) {
@@ -777,6 +952,24 @@ void WebOSSurfaceItem::setLaunchRequired(bool required)
     }
 }
 
+void WebOSSurfaceItem::setDisplayAffinity(int displayId, bool updateProperty)
+{
+    if (displayId < 0) {
+        qWarning() << "invalid display affinity" << displayId << "for" << this;
+        return;
+    }
+
+    if (m_displayAffinity != displayId) {
+        qInfo() << this << "displayAffinity:" << m_displayAffinity << "->" << displayId;
+        m_displayAffinity = displayId;
+        emit displayAffinityChanged();
+        // Let window models move the item to the right display
+        emit dataChanged();
+        if (updateProperty)
+            setWindowProperty(QLatin1String("displayAffinity"), m_displayAffinity);
+    }
+}
+
 void WebOSSurfaceItem::setSurfaceGroup(WebOSSurfaceGroup* group)
 {
     PMTRACE_FUNCTION;
@@ -973,56 +1166,60 @@ WebOSSurfaceItem::KeyMasks WebOSSurfaceItem::keyMaskFromQt(int key) const
     return retKeyMask;
 }
 
+/* Cursor bitmaps converted from the cursor surface, looked up by content */
+struct CursorKey {
+    uint hash;
+    QSize size;
+    int hotSpotX;
+    int hotSpotY;
+
+    bool operator==(const CursorKey &other) const
+    {
+        return hash == other.hash && size == other.size &&
+            hotSpotX == other.hotSpotX && hotSpotY == other.hotSpotY;
+    }
+};
+
+static inline uint qHash(const CursorKey &key, uint seed = 0)
+{
+    return key.hash ^ qHash(key.hotSpotX, seed) ^ (qHash(key.hotSpotY, seed) << 1) ^
+        qHash(key.size.width() * 4096 + key.size.height(), seed);
+}
+
+struct CursorEntry {
+    QImage image; // to tell hash collisions apart
+    QCursor cursor;
+};
+
+// Enough for the frames of the animated cursors of a client
+static const int CursorCacheSize = 32;
+
 /* This BufferAttacher is from qwindow compositor example in QtWayland */
+// Only used for cursor surfaces, which are not drawn in the scene. It
+// keeps the buffer for image() and does no GL, so it is used on the GUI
+// thread only whichever render loop is in use.
 class BufferAttacher : public QWaylandBufferAttacher
 {
 public:
     BufferAttacher()
         : QWaylandBufferAttacher()
-          , shmTex(0)
           , bufferRef(QWaylandBufferRef())
+          , hashValid(false)
+          , contentHash(0)
+          , cursorCache(CursorCacheSize)
     {
     }
 
-    ~BufferAttacher()
-    {
-        delete shmTex;
-    }
-
     void attach(const QWaylandBufferRef &ref) Q_DECL_OVERRIDE
     {
-        if (bufferRef) {
-            if (bufferRef.isShm()) {
-                delete shmTex;
-                shmTex = 0;
-            } else {
-                bufferRef.destroyTexture();
-            }
-        }
-
         bufferRef = ref;
-
-        if (bufferRef) {
-            if (bufferRef.isShm()) {
-                shmTex = new QOpenGLTexture(bufferRef.image(), QOpenGLTexture::DontGenerateMipMaps);
-                texture = shmTex->textureId();
-            } else {
-                texture = bufferRef.createTexture();
-            }
-        }
+        hashValid = false;
     }
 
     void unmap()
     {
-        if (bufferRef) {
-            if (bufferRef.isShm()) {
-                delete shmTex;
-                shmTex = NULL;
-            } else {
-                bufferRef.destroyTexture();
-            }
-        }
         bufferRef = QWaylandBufferRef();
+        hashValid = false;
     }
 
     QImage image() const
@@ -1032,20 +1229,76 @@ public:
         return bufferRef.image();
     }
 
-    QOpenGLTexture *shmTex;
+    // Returns the cursor for the current buffer, converting it only
+    // if the same content has not been seen with this hotspot before
+    bool cursor(int hotSpotX, int hotSpotY, QCursor &cursor)
+    {
+        QImage img = image();
+        if (img.isNull())
+            return false;
+
+        if (!hashValid) {
+            contentHash = qHashBits(img.constBits(), img.byteCount());
+            hashValid = true;
+        }
+
+        CursorKey key = { contentHash, img.size(), hotSpotX, hotSpotY };
+        CursorEntry *entry = cursorCache.object(key);
+        if (entry && entry->image == img) {
+            cursor = entry->cursor;
+            return true;
+        }
+
+        cursor = QCursor(QPixmap::fromImage(img), hotSpotX, hotSpotY);
+        if (cursor.shape() != Qt::BitmapCursor)
+            return false;
+
+        // The buffer belongs to the client, keep a copy of our own
+        entry = new CursorEntry;
+        entry->image = img.copy();
+        entry->cursor = cursor;
+        cursorCache.insert(key, entry);
+        return true;
+    }
+
     QWaylandBufferRef bufferRef;
-    GLuint texture;
+
+private:
+    bool hashValid;
+    uint contentHash;
+    QCache<CursorKey, CursorEntry> cursorCache;
 };
 
+/*
+ * Our attachers by cursor surface, one per surface shared by all the items
+ * of the client so that its cursor cache is too. The attacher a surface has
+ * may be QtWayland's own, so it is looked up here and never cast.
+ */
+static QHash<QWaylandSurface *, BufferAttacher *> cursorAttachers;
+
+static BufferAttacher *cursorAttacher(QWaylandSurface *surface)
+{
+    BufferAttacher *attacher = cursorAttachers.value(surface);
+    if (!attacher) {
+        attacher = new BufferAttacher();
+        cursorAttachers.insert(surface, attacher);
+        QObject::connect(surface, &QObject::destroyed, [surface, attacher]() {
+            cursorAttachers.remove(surface);
+            delete attacher;
+        });
+    }
+    return attacher;
+}
+
 bool WebOSSurfaceItem::getCursorFromSurface(QWaylandSurface *surface, int hotSpotX, int hotSpotY, QCursor& cursor)
 {
-    if (surface && surface->bufferAttacher()) {
-        QImage image = static_cast<BufferAttacher *>(surface->bufferAttacher())->image();
+    BufferAttacher *attacher = cursorAttachers.value(surface);
+    if (attacher) {
+        QImage image = attacher->image();
         if (!image.isNull()) {
             if (hotSpotX >= 0 && hotSpotX <= image.size().width() &&
                 hotSpotY >= 0 && hotSpotY <= image.size().height()) {
-                cursor = QCursor(QPixmap::fromImage(image), hotSpotX, hotSpotY);
-                if (cursor.shape() == Qt::BitmapCursor) {
+                if (attacher->cursor(hotSpotX, hotSpotY, cursor)) {
                     return true;
                 } else {
                     qWarning() << "Cursor: unable to convert surface into a bitmap cursor";
@@ -1086,7 +1339,13 @@ void WebOSSurfaceItem::setCursorSurface(QWaylandSurface *surface, int hotSpotX,
         if (m_cursorSurface) {
             qDebug() << "Cursor: disconnect old cursor surface" << m_cursorSurface.data() << "static:" << staticCursor;
             QObject::disconnect(m_cursorSurface.data(), SIGNAL(redraw()), this, SLOT(updateCursor()));
-            m_cursorSurface->setBufferAttacher(0);
+            BufferAttacher *attacher = cursorAttachers.value(m_cursorSurface.data());
+            if (attacher && m_cursorSurface->bufferAttacher() == attacher) {
+                m_cursorSurface->setBufferAttacher(0);
+                // Not to hold on to a buffer of the client until it is used again
+                if (m_cursorSurface != surface)
+                    attacher->unmap();
+            }
         }
 
         if (staticCursor) {
@@ -1095,7 +1354,8 @@ void WebOSSurfaceItem::setCursorSurface(QWaylandSurface *surface, int hotSpotX,
         } else if (surface) {
             qDebug() << "Cursor: set a live cursor with cursor surface" << surface << "static:" << staticCursor;
             connect(surface, SIGNAL(redraw()), this, SLOT(updateCursor()), Qt::UniqueConnection);
-            surface->setBufferAttacher(new BufferAttacher());
+            // Replaces whichever attacher the surface has, as it is not drawn in the scene
+            surface->setBufferAttacher(cursorAttacher(surface));
             if (getCursorFromSurface(surface, hotSpotX, hotSpotY, cursor)) {
                 setCursor(cursor);
             } else {
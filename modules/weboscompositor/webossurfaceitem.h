@@ -21,7 +21,11 @@
 
 #include <QObject>
 #include <QPointer>
+#include <QRegion>
+#include <QStringList>
+#include <QTimer>
 #include <QFlags>
+#include <QUrl>
 #include <QtCompositor/qwaylandinput.h>
 
 #include <qwaylandsurfaceitem.h>
@@ -35,6 +39,7 @@ class WebOSCoreCompositor;
 class WebOSWindowModel;
 class WebOSGroupedWindowModel;
 class WebOSShellSurface;
+class QQmlPropertyMap;
 
 class WebOSSurfaceItem;
 class WebOSSurfaceGroup;
@@ -53,7 +58,9 @@ class WEBOS_COMPOSITOR_EXPORT WebOSSurfaceItem : public QWaylandSurfaceItem
     Q_FLAGS(KeyMasks)
 
     Q_PROPERTY(bool fullscreen READ fullscreen WRITE setFullscreen NOTIFY fullscreenChanged)
+    // Prefer windowPropertyMap, any change of this notifies all bindings
     Q_PROPERTY(QVariantMap windowProperties READ windowProperties NOTIFY windowPropertiesChanged)
+    Q_PROPERTY(QObject* windowPropertyMap READ windowPropertyMap CONSTANT)
     Q_PROPERTY(QString appId READ appId NOTIFY appIdChanged)
     Q_PROPERTY(QString type READ type NOTIFY typeChanged)
     Q_PROPERTY(WindowClass windowClass READ windowClass WRITE setWindowClass NOTIFY windowClassChanged)
@@ -61,6 +68,7 @@ class WEBOS_COMPOSITOR_EXPORT WebOSSurfaceItem : public QWaylandSurfaceItem
     Q_PROPERTY(QString subtitle READ subtitle WRITE setSubtitle NOTIFY subtitleChanged)
     Q_PROPERTY(QString params READ params NOTIFY paramsChanged)
     Q_PROPERTY(QString cardSnapShotFilePath READ cardSnapShotFilePath NOTIFY cardSnapShotFilePathChanged)
+    Q_PROPERTY(QUrl cardSnapShotUrl READ cardSnapShotUrl NOTIFY cardSnapShotFilePathChanged)
     Q_PROPERTY(QString customImageFilePath READ customImageFilePath WRITE setCustomImageFilePath NOTIFY customImageFilePathChanged)
     Q_PROPERTY(QString backgroundImageFilePath READ backgroundImageFilePath WRITE setBackgroundImageFilePath NOTIFY backgroundImageFilePathChanged)
     Q_PROPERTY(QString backgroundColor READ backgroundColor WRITE setBackgroundColor)
@@ -77,9 +85,11 @@ class WEBOS_COMPOSITOR_EXPORT WebOSSurfaceItem : public QWaylandSurfaceItem
     Q_PROPERTY(Qt::WindowState state READ state WRITE setState NOTIFY stateChanged)
     Q_PROPERTY(bool notifyPositionToClient READ notifyPositionToClient WRITE setNotifyPositionToClient NOTIFY notifyPositionToClientChanged)
     Q_PROPERTY(bool exposed READ exposed WRITE setExposed NOTIFY exposedChanged)
+    Q_PROPERTY(bool opaque READ opaque WRITE setOpaque NOTIFY opaqueChanged)
     Q_PROPERTY(bool hasKeyboardFocus READ hasKeyboardFocus NOTIFY hasKeyboardFocusChanged)
     Q_PROPERTY(bool grabKeyboardFocusOnClick READ grabKeyboardFocusOnClick)
     Q_PROPERTY(bool launchRequired READ isLaunchRequired WRITE setLaunchRequired NOTIFY launchRequiredChanged)
+    Q_PROPERTY(int displayAffinity READ displayAffinity WRITE setDisplayAffinity NOTIFY displayAffinityChanged)
 
     Q_PROPERTY(WebOSSurfaceGroup* surfaceGroup READ surfaceGroup NOTIFY surfaceGroupChanged)
 
@@ -188,6 +198,8 @@ public:
     void mouseUngrabEvent() Q_DECL_OVERRIDE;
 
 protected:
+    void geometryChanged(const QRectF &newGeometry, const QRectF &oldGeometry) Q_DECL_OVERRIDE;
+
     virtual void keyPressEvent(QKeyEvent *event);
     virtual void keyReleaseEvent(QKeyEvent *event);
     virtual void focusInEvent(QFocusEvent *event);
@@ -218,6 +230,13 @@ public:
     void setFullscreen(bool enabled);
 
     QVariantMap windowProperties();
+    /*!
+     * Returns the window properties as an object with a property and a
+     * change signal per key, so that a QML binding on one of them is only
+     * evaluated again when that one changes. Read-only from QML. Created
+     * on first use.
+     */
+    QObject *windowPropertyMap();
 
     void setWindowProperty(const QString& key, const QVariant& value);
 
@@ -309,16 +328,12 @@ public:
     /*!
      * Convenience function to return the processId for this surface.
      */
-    QString processId() {
-        pid_t pid;
-        struct wl_client *client = surface() ? static_cast<struct wl_client *>(surface()->client()) : NULL;
-        if (client)
-            wl_client_get_credentials(client, &pid, 0,0);
-        else
-            pid = getpid();
-        m_processId = QString("%1").arg(pid);
-        return m_processId;
-    }
+    QString processId() const { return QString::number(m_processId); }
+
+    /*!
+     * Returns the pid of the client, resolved once when the item is created.
+     */
+    pid_t pid() const { return m_processId; }
 
     /*!
      * Convenience function to return the time since the last fullscreen mode for this surface.
@@ -341,6 +356,13 @@ public:
     QString cardSnapShotFilePath()    { return m_cardSnapShotFilePath; }
     QString getCardSnapShotFilePath() { return cardSnapShotFilePath(); }
 
+    /*!
+     * Returns the url to show the snapshot with. Unlike loading the file
+     * directly, it is decoded off the GUI thread and shares one texture
+     * with other users of the same snapshot.
+     */
+    QUrl cardSnapShotUrl();
+
     /*!
      * Function to get/set custom image path to snapshot.
      */
@@ -360,7 +382,7 @@ public:
     void setBackgroundColor(QString color) { m_backgroundColor = color; }
 
     /*!
-     * Function to delete snapshot.
+     * Function to delete snapshot. The file is removed asynchronously.
      */
     void deleteSnapShot();
 
@@ -396,10 +418,38 @@ public:
 
     bool notifyPositionToClient() { return m_notifyPositionToClient; }
     bool exposed() { return m_exposed; }
+    /*!
+     * The part of the surface, in surface coordinates, last sent to the
+     * client as exposed. Computed by WebOSCoreCompositor once per frame.
+     */
+    QRegion exposedRegion() const { return m_exposedRegion; }
+    /*!
+     * Sends \a region as exposed unless \a immediate is false and another
+     * region has been sent within ExposedRegionInterval. In that case only
+     * the last region set in the meantime is sent once the interval is
+     * over, so that a surface moving over another one does not make the
+     * latter receive an event every frame.
+     */
+    void setExposedRegion(const QRegion &region, bool immediate = false);
+
+    /*!
+     * Whether the content of the surface has no transparent parts, so that
+     * it hides what is stacked below it when fully opaque on the screen.
+     * Set by the shell, false by default.
+     */
+    bool opaque() const { return m_opaque; }
+    void setOpaque(bool opaque);
 
     bool isLaunchRequired() { return m_launchRequired; }
     void setLaunchRequired(bool required);
 
+    /*!
+     * The display (WebOSCompositorWindow::displayId) this item is to be shown on.
+     * Can be set by the client with the "displayAffinity" window property.
+     */
+    int displayAffinity() const { return m_displayAffinity; }
+    void setDisplayAffinity(int displayId, bool updateProperty = true);
+
     ItemState itemState() { return m_itemState; }
     void setItemState(ItemState state);
 
@@ -423,7 +473,8 @@ public slots:
 
     void setExposed(bool exposed);
 
-    void updateProperties(const QVariantMap &properties, const QString &name, const QVariant &value);
+    /*! Mirrors the \a changed window properties on the item at once */
+    void updateProperties(const QVariantMap &properties, const QStringList &changed);
 
     void updateCursor();
 
@@ -467,7 +518,9 @@ signals:
     void stateChanged();
     void notifyPositionToClientChanged();
     void exposedChanged();
+    void opaqueChanged();
     void launchRequiredChanged();
+    void displayAffinityChanged();
 
     void surfaceGroupChanged();
 
@@ -494,6 +547,7 @@ private:
     QString m_backgroundImageFilePath;
     QString m_backgroundColor;
     WebOSShellSurface* m_shellSurface;
+    QQmlPropertyMap* m_windowPropertyMap;
     ItemState m_itemState;
 
     bool m_notifyPositionToClient;
@@ -505,15 +559,24 @@ private:
     QString m_subtitle;
     QString m_params;
 
-    QString m_processId;
+    pid_t m_processId;
     bool m_exposed;
+    QRegion m_exposedRegion;
+    QRegion m_pendingExposedRegion;
+    QTimer m_exposedRegionTimer;
+    bool m_opaque;
     bool m_launchRequired;
+    int m_displayAffinity;
     bool m_hasKeyboardFocus;
     bool m_grabKeyboardFocusOnClick;
 
     WebOSSurfaceGroup* m_surfaceGroup;
 
     void sendCloseToGroupItems();
+    void sendExposedRegion();
+
+    void updateWindowPropertyMap(const QString &key, const QVariant &value);
+    void resetWindowPropertyMap();
 
     bool getCursorFromSurface(QWaylandSurface *surface, int hotSpotX, int hotSpotY, QCursor& cursor);
 
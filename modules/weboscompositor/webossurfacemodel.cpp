@@ -21,6 +21,8 @@
 
 WebOSSurfaceModel::WebOSSurfaceModel(QObject *parent)
     : m_dataDirty(false)
+    , m_viewsPending(false)
+    , m_displayCount(1)
     , m_firstDirtyIndex(0)
     , m_lastDirtyIndex(0)
 {
@@ -38,6 +40,27 @@ WebOSSurfaceModel::~WebOSSurfaceModel()
     clear();
 }
 
+void WebOSSurfaceModel::setViewsPending(bool pending)
+{
+    if (m_viewsPending != pending) {
+        m_viewsPending = pending;
+        emit viewsPendingChanged();
+    }
+}
+
+void WebOSSurfaceModel::setDisplayCount(int count)
+{
+    if (m_displayCount != count) {
+        m_displayCount = count;
+        emit displayCountChanged();
+    }
+}
+
+void WebOSSurfaceModel::announce(WebOSSurfaceItem* item)
+{
+    emit surfaceAnnounced(item);
+}
+
 QHash<int, QByteArray> WebOSSurfaceModel::roleNames () const
 {
     return roles;
@@ -53,6 +53,26 @@ public:
     // For debug purposes, remove when not needed
     const QList<WebOSSurfaceItem*>& getItems() const { return m_list; }
 
+    /*!
+     * Whether the views are still being created. Window models getting
+     * this model as their source meanwhile note the surfaces in it, and
+     * announce() has them emit surfaceAdded for those later on.
+     */
+    bool viewsPending() const { return m_viewsPending; }
+    void setViewsPending(bool pending);
+    /*!
+     * Has the window models noted \a item emit surfaceAdded for it, as
+     * they would have if they had existed when it was mapped.
+     */
+    void announce(WebOSSurfaceItem* item);
+
+    /*!
+     * The number of displays with a window. Items with a display affinity
+     * beyond it are shown on the primary display.
+     */
+    int displayCount() const { return m_displayCount; }
+    void setDisplayCount(int count);
+
 public slots:
     void surfaceMapped(WebOSSurfaceItem* surface);
     void surfaceUnmapped(WebOSSurfaceItem* surface);
@@ -63,9 +83,14 @@ private slots:
     void handleDeferDataChanged();
 signals:
     void deferDataChanged();
+    void viewsPendingChanged();
+    void displayCountChanged();
+    void surfaceAnnounced(WebOSSurfaceItem* item);
 
 private:
     bool m_dataDirty;
+    bool m_viewsPending;
+    int m_displayCount;
     int m_firstDirtyIndex;
     int m_lastDirtyIndex;
     QList<WebOSSurfaceItem*> m_list;
@@ -21,6 +21,7 @@
 
 WebOSWindowModel::WebOSWindowModel()
     : m_locked(false),
+      m_displayId(-1),
       m_filterDirty(false)
 {
     PMTRACE_FUNCTION;
@@ -119,13 +120,23 @@ bool WebOSWindowModel::filterAcceptsRow(int sourceRow,
          const QModelIndex &sourceParent) const
 {
     PMTRACE_FUNCTION;
+    QModelIndex index0 = sourceModel()->index(sourceRow, 0, sourceParent);
+    WebOSSurfaceItem* item = sourceModel()->data(index0).value<WebOSSurfaceItem*>();
+
+    if (m_displayId >= 0) {
+        // Shown on the primary display if there is no window for its own
+        int affinity = item->displayAffinity();
+        if (affinity < 0 || affinity >= surfaceSource()->displayCount())
+            affinity = 0;
+        if (affinity != m_displayId)
+            return false;
+    }
+
     // no filters defined, accept all window types
     if(windowType().isEmpty() && m_acceptFunc.isEmpty()) {
         return true;
     }
 
-    QModelIndex index0 = sourceModel()->index(sourceRow, 0, sourceParent);
-    WebOSSurfaceItem* item = sourceModel()->data(index0).value<WebOSSurfaceItem*>();
     bool accepts = false;
     if (!m_acceptFunc.isEmpty()) {
         QVariant returnedValue;
@@ -150,8 +161,47 @@ void WebOSWindowModel::setSurfaceSource(WebOSSurfaceModel* source) {
         // changing the source also invalidates the filter already,
         // so we don't have to invalidate twice
         m_filterDirty = false;
+        disconnectAnnouncements();
+        if (surfaceSource())
+            disconnect(surfaceSource(), &WebOSSurfaceModel::displayCountChanged, this, &WebOSWindowModel::deferInvalidate);
         setSourceModel(source);
+        if (source)
+            connect(source, &WebOSSurfaceModel::displayCountChanged, this, &WebOSWindowModel::deferInvalidate);
         emit surfaceSourceChanged();
+
+        // Resetting the model does not tell about the surfaces mapped
+        // already. Those mapped before the views were created are announced
+        // by the compositor once they are, in the order they were mapped.
+        m_existingSurfaces.clear();
+        if (source && source->viewsPending()) {
+            for (int row = 0; row < rowCount(); row++)
+                m_existingSurfaces << data(index(row, 0)).value<WebOSSurfaceItem*>();
+            connect(source, &WebOSSurfaceModel::surfaceAnnounced, this, &WebOSWindowModel::onSurfaceAnnounced);
+            connect(source, &WebOSSurfaceModel::viewsPendingChanged, this, &WebOSWindowModel::onViewsPendingChanged);
+        }
+    }
+}
+
+void WebOSWindowModel::onSurfaceAnnounced(WebOSSurfaceItem* item)
+{
+    // Unless removed in the meantime
+    if (m_existingSurfaces.removeAll(item) > 0 && indexForItem(QVariant::fromValue<WebOSSurfaceItem*>(item)) >= 0)
+        emit surfaceAdded(item);
+}
+
+void WebOSWindowModel::onViewsPendingChanged()
+{
+    m_existingSurfaces.clear();
+    disconnectAnnouncements();
+}
+
+void WebOSWindowModel::disconnectAnnouncements()
+{
+    // Only ours, the proxy model has its own connections to the source
+    WebOSSurfaceModel* source = surfaceSource();
+    if (source) {
+        disconnect(source, &WebOSSurfaceModel::surfaceAnnounced, this, &WebOSWindowModel::onSurfaceAnnounced);
+        disconnect(source, &WebOSSurfaceModel::viewsPendingChanged, this, &WebOSWindowModel::onViewsPendingChanged);
     }
 }
 
@@ -210,3 +260,12 @@ void WebOSWindowModel::setLocked(bool locked)
 
     emit lockedChanged();
 }
+
+void WebOSWindowModel::setDisplayId(int displayId)
+{
+    if (m_displayId != displayId) {
+        m_displayId = displayId;
+        deferInvalidate();
+        emit displayIdChanged();
+    }
+}
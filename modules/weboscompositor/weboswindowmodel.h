@@ -23,6 +23,7 @@
 #include <QSortFilterProxyModel>
 #include <QList>
 #include <QHash>
+#include <QPointer>
 
 class WebOSSurfaceModel;
 class WebOSSurfaceItem;
@@ -37,6 +38,7 @@ class WEBOS_COMPOSITOR_EXPORT WebOSWindowModel : public QSortFilterProxyModel {
     Q_PROPERTY(QString acceptFunction READ acceptFunction WRITE setAcceptFunction NOTIFY acceptFunctionChanged);
     Q_PROPERTY(int count READ count NOTIFY countChanged);
     Q_PROPERTY(bool locked READ locked WRITE setLocked NOTIFY lockedChanged);
+    Q_PROPERTY(int displayId READ displayId WRITE setDisplayId NOTIFY displayIdChanged);
 
 public:
     WebOSWindowModel();
@@ -64,6 +66,10 @@ public:
 
     bool locked();
     void setLocked(bool);
+
+    // Accepts only the items with the given display affinity, -1 for any
+    int displayId() const { return m_displayId; }
+    void setDisplayId(int displayId);
 signals:
      void windowTypeChanged();
      void surfaceSourceChanged();
@@ -73,6 +79,7 @@ signals:
      void surfaceRemoved(WebOSSurfaceItem* item);
      void countChanged();
      void lockedChanged();
+     void displayIdChanged();
      void deferredInvalidate();
      void invalidated();
 
@@ -86,14 +93,26 @@ protected slots:
     virtual void handleInvalidate();
     void deferInvalidate();
 
+private slots:
+    void onSurfaceAnnounced(WebOSSurfaceItem* item);
+    void onViewsPendingChanged();
+
 protected:
     bool m_filterDirty;
 
 private:
+     void disconnectAnnouncements();
+
      QString m_type;
      QString m_sortFunc;
      QString m_acceptFunc;
      bool m_locked;
+     int m_displayId;
+     /*!
+      * In the source when it was set while the views were pending, to be
+      * announced with surfaceAdded then
+      */
+     QList<QPointer<WebOSSurfaceItem> > m_existingSurfaces;
 };
 
 #endif
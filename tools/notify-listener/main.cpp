@@ -0,0 +1,170 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+/*
+ * Stands in for the service manager to check the readiness notification of
+ * the compositor. Binds a datagram socket, runs the command with
+ * NOTIFY_SOCKET pointing at it and waits for a message with READY=1.
+ *
+ * Usage: notify-listener [-t seconds] <socket> [command [args...]]
+ *
+ * A socket starting with '@' is in the abstract namespace, as systemd may
+ * pass it. Without a command, it waits for anyone to send to the socket.
+ * Exits with 0 once READY=1 is received, 1 otherwise.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-t seconds] <socket> [command [args...]]\n", name);
+}
+
+// Whether one of the newline separated assignments is READY=1
+static bool hasReady(const char *message)
+{
+    const char *line = message;
+    while (line && *line) {
+        const char *end = strchr(line, '\n');
+        size_t length = end ? size_t(end - line) : strlen(line);
+        if (length == 7 && strncmp(line, "READY=1", 7) == 0)
+            return true;
+        line = end ? end + 1 : NULL;
+    }
+    return false;
+}
+
+static long long now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+int main(int argc, char *argv[])
+{
+    int timeout = 30;
+    int arg = 1;
+    if (arg + 1 < argc && strcmp(argv[arg], "-t") == 0) {
+        timeout = atoi(argv[arg + 1]);
+        arg += 2;
+    }
+    if (arg >= argc || timeout <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const char *path = argv[arg++];
+    size_t length = strlen(path);
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (length == 0 || length >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Invalid socket %s\n", path);
+        return 1;
+    }
+    memcpy(addr.sun_path, path, length);
+
+    // Same as the sender does, no trailing nul for an abstract name
+    bool abstract = path[0] == '@';
+    if (abstract)
+        addr.sun_path[0] = '\0';
+    else
+        unlink(path);
+
+    int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return 1;
+    }
+
+    socklen_t addrLength = offsetof(struct sockaddr_un, sun_path) + length;
+    if (bind(fd, (struct sockaddr *) &addr, addrLength) < 0) {
+        perror("bind");
+        return 1;
+    }
+
+    pid_t child = -1;
+    if (arg < argc) {
+        child = fork();
+        if (child < 0) {
+            perror("fork");
+            return 1;
+        }
+        if (child == 0) {
+            setenv("NOTIFY_SOCKET", path, 1);
+            execvp(argv[arg], argv + arg);
+            perror("execvp");
+            _exit(127);
+        }
+    }
+
+    bool ready = false;
+    long long deadline = now() + timeout * 1000LL;
+    while (!ready) {
+        long long left = deadline - now();
+        if (left <= 0) {
+            fprintf(stderr, "No READY=1 on %s within %d s\n", path, timeout);
+            break;
+        }
+
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        int ret = poll(&pfd, 1, int(left));
+        if (ret < 0 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+        if (ret <= 0)
+            continue;
+
+        char message[4096];
+        ssize_t received = recv(fd, message, sizeof(message) - 1, 0);
+        if (received < 0) {
+            perror("recv");
+            break;
+        }
+        message[received] = '\0';
+        printf("Received on %s: \"%s\"\n", path, message);
+        ready = hasReady(message);
+    }
+
+    if (ready)
+        printf("READY=1 received on %s socket %s\n", abstract ? "abstract" : "path", path);
+
+    close(fd);
+    if (!abstract)
+        unlink(path);
+
+    // The command is only run until it says it is ready
+    if (child > 0) {
+        kill(child, SIGTERM);
+        waitpid(child, NULL, 0);
+    }
+
+    return ready ? 0 : 1;
+}
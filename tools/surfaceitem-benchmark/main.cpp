@@ -0,0 +1,87 @@
+// Copyright (c) 2018 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+/*
+ * Measures what WebOSSurfaceItem costs: the heap taken per item and the
+ * time to construct and destroy them, for items without a surface as proxy
+ * items are.
+ *
+ * Usage: surfaceitem-benchmark [count] (1000 by default)
+ * Runs on the offscreen platform unless QT_QPA_PLATFORM says otherwise.
+ */
+
+#include <QGuiApplication>
+#include <QElapsedTimer>
+#include <QList>
+#include <QTextStream>
+
+#include <malloc.h>
+
+#include "webossurfaceitem.h"
+
+static qint64 heapInUse()
+{
+    struct mallinfo info = mallinfo();
+    return info.uordblks;
+}
+
+int main(int argc, char *argv[])
+{
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QGuiApplication app(argc, argv);
+    QTextStream out(stdout);
+
+    int count = 1000;
+    if (argc > 1)
+        count = QByteArray(argv[1]).toInt();
+    if (count <= 0) {
+        out << "Usage: " << argv[0] << " [count]" << endl;
+        return 1;
+    }
+
+    // The first one pays for the static data of the class
+    delete new WebOSSurfaceItem(NULL, NULL);
+
+    QList<WebOSSurfaceItem *> items;
+    items.reserve(count);
+
+    qint64 heapBefore = heapInUse();
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < count; i++) {
+        WebOSSurfaceItem *item = new WebOSSurfaceItem(NULL, NULL);
+        // A few apps with many windows, as on a device
+        item->setAppId(QStringLiteral("com.webos.app.benchmark%1").arg(i % 16), false);
+        item->setType(QStringLiteral("_WEBOS_WINDOW_TYPE_CARD"), false);
+        items << item;
+    }
+    qint64 constructed = timer.nsecsElapsed();
+    qint64 heapAfter = heapInUse();
+
+    timer.restart();
+    qDeleteAll(items);
+    qint64 destroyed = timer.nsecsElapsed();
+
+    out << "items:        " << count << endl;
+    out << "sizeof:       " << sizeof(WebOSSurfaceItem) << " bytes" << endl;
+    out << "heap:         " << (heapAfter - heapBefore) / count << " bytes per item" << endl;
+    out << "construction: " << constructed / 1000000.0 << " ms, " << constructed / 1000.0 / count << " us per item" << endl;
+    out << "destruction:  " << destroyed / 1000000.0 << " ms, " << destroyed / 1000.0 / count << " us per item" << endl;
+
+    return 0;
+}